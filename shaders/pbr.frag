@@ -61,7 +61,7 @@ void main()
 
             // attenuation
             float dis = length(light.pos - world_pos);
-            vec3 L_color = light.color * 10.0/ (dis*dis);
+            vec3 L_color = light.color * spot_falloff(light.direction, light.cone_angle, L) * 10.0/ (dis*dis);
 
             out_color.xyz += L_color * (diffuse + specular);
             continue;
@@ -84,7 +84,7 @@ void main()
 
         // attenuation
         float dis = length(light.pos - world_pos);
-        vec3 L_color = light.color * 10.0/ (dis*dis);
+        vec3 L_color = light.color * spot_falloff(light.direction, light.cone_angle, L) * 10.0/ (dis*dis);
 
         vec3 brdf = max((vec3(1.0) - F) * lambert + cook_torrance, vec3(0));
         vec3 emissive = mat.base_color * mat.emissive;
@@ -12,12 +12,13 @@ layout(std140, set = 0, binding = 0) uniform camera_ubo
 // light data
 layout(location = 0) in vec4 pos;
 layout(location = 1) in vec4 color;
+layout(location = 2) in vec4 direction; // xyz = direction, w = cone angle
 
 layout(location = 0) out vec4 frag_color;
 
 void main()
 {
     gl_Position = camera.proj * camera.view * vec4(pos.xyz, 1);
-    gl_PointSize = 10;
+    gl_PointSize = direction.w < LIGHT_CONE_OMNI ? 14 : 10; // spot lights are drawn larger
     frag_color = vec4(color.xyz, 1);
 }
@@ -1,8 +1,35 @@
 #version 460
+#extension GL_GOOGLE_include_directive : enable
 
+#define GLSL
+#include "../src/shader_data.h"
+
+layout(std430, set = 0, binding = 3) readonly buffer material_sbo 
+{
+    material_t materials[];
+};
+layout(std430, set = 0, binding = 4) readonly buffer mesh_sbo
+{
+    mesh_info_t meshes[];
+};
+
+layout(location = 0) in vec3 normal;
+layout(location = 1) in vec4 clip_position;
+layout(location = 2) in vec4 prev_clip_position;
+layout(location = 3) flat in int mesh_index;
+
+// world normal, w = 1 where geometry was rendered (cleared to 0)
 layout(location = 0) out vec4 out_color;
+// motion vector = uv - uv in the previous frame
+layout(location = 1) out vec2 out_motion;
+// base color of the material (white without material), guides the denoiser
+layout(location = 2) out vec4 out_albedo;
 
 void main()
 {
-    out_color = vec4(1);
+    out_color = vec4(normalize(normal), 1);
+    out_motion = (clip_position.xy / clip_position.w - prev_clip_position.xy / prev_clip_position.w) * 0.5;
+
+    int material_index = meshes[mesh_index].material_index;
+    out_albedo = vec4(material_index == -1 ? vec3(1) : materials[material_index].base_color, 1);
 }
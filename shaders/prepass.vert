@@ -25,12 +25,20 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv;
 
+layout(location = 0) out vec3 out_normal; // world space
+layout(location = 1) out vec4 out_clip_position;
+layout(location = 2) out vec4 out_prev_clip_position; // with the camera of the previous frame (models do not move)
+layout(location = 3) flat out int out_mesh_index;
+
 void main() 
 {
     model_data data = models[gl_InstanceIndex]; 
 
-    mat4 model_view = camera.view * data.model;
-    vec4 pos = model_view * vec4(position, 1);
-    gl_Position = camera.proj * pos;
+    vec4 world_position = data.model * vec4(position, 1);
+    gl_Position = camera.proj * camera.view * world_position;
+    out_normal = mat3(camera.inv_view) * mat3(data.normal) * normal;
+    out_clip_position = gl_Position;
+    out_prev_clip_position = camera.prev_view_proj * world_position;
+    out_mesh_index = data.mesh_index;
 }
 
@@ -249,8 +249,7 @@ void init_context(gpu_context_t& ctx, window_t* window)
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, properties.data());
 		ctx.q_graphics_index = ctx.q_present_index = ctx.q_transfer_index = ctx.q_compute_index = count;
 
-        // TODO Choose seperate queue for compute and transfer if possible
-		// Get queue indices
+		// Get queue indices (first family that supports it)
 		for (u32 i = 0; i < count; ++i)
 		{
 			VkBool32 present_support = VK_FALSE;
@@ -278,9 +277,38 @@ void init_context(gpu_context_t& ctx, window_t* window)
 			}
 		}
 
+		// prefer families without graphics for compute and without graphics and compute for transfer so they 
+		// run asynchronously to the graphics queue (dedicated async compute and dma queues)
+		for (u32 i = 0; i < count; ++i)
+		{
+			VkQueueFlags flags = properties[i].queueFlags;
+			if (properties[i].queueCount <= 0 || flags & VK_QUEUE_GRAPHICS_BIT)
+				continue;
+
+			bool compute_async = ctx.q_compute_index < count && !(properties[ctx.q_compute_index].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (!compute_async && flags & VK_QUEUE_COMPUTE_BIT)
+			{
+				ctx.q_compute_index = i;
+			}
+			bool transfer_dma = ctx.q_transfer_index < count 
+				&& !(properties[ctx.q_transfer_index].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+			if (!transfer_dma && flags & VK_QUEUE_TRANSFER_BIT && !(flags & VK_QUEUE_COMPUTE_BIT))
+			{
+				ctx.q_transfer_index = i;
+			}
+		}
+
 		LOG_INFO("Present: %d, Graphics: %d, Compute: %d, Transfer: %d", 
                 ctx.q_present_index, ctx.q_graphics_index, ctx.q_compute_index, ctx.q_transfer_index);
 
+		// timestamps can not be written on a queue without valid bits (the profiler skips that queue)
+		ctx.q_graphics_timestamps = ctx.q_graphics_index < count && properties[ctx.q_graphics_index].timestampValidBits != 0;
+		ctx.q_compute_timestamps = ctx.q_compute_index < count && properties[ctx.q_compute_index].timestampValidBits != 0;
+		if (!ctx.q_compute_timestamps)
+		{
+			LOG_INFO("Compute queue family %d has no timestamps", ctx.q_compute_index);
+		}
+
 		if (ctx.q_present_index < count && ctx.q_graphics_index < count && ctx.q_transfer_index < count && ctx.q_compute_index < count)
 		{
 			ctx.physical_device = device;
@@ -297,6 +325,9 @@ void init_context(gpu_context_t& ctx, window_t* window)
 
 	// Create queues
 	std::set<u32> indices = { ctx.q_graphics_index, ctx.q_present_index, ctx.q_transfer_index, ctx.q_compute_index };
+	// buffers are used by all queues (concurrent sharing mode if they are from different families)
+	std::set<u32> buffer_families = { ctx.q_graphics_index, ctx.q_transfer_index, ctx.q_compute_index };
+	ctx.queue_families.assign(buffer_families.begin(), buffer_families.end());
 	std::vector<VkDeviceQueueCreateInfo> queue_infos;
 	f32 priority = 1.0f;
 
@@ -394,9 +425,8 @@ static void create_frame_resources(gpu_context_t& ctx)
 	VkCommandPoolCreateInfo cmd_pool_info{};
 	cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	cmd_pool_info.queueFamilyIndex = ctx.q_graphics_index;
-#ifdef  VK_RTX_ON
-	cmd_pool_info.queueFamilyIndex = ctx.q_compute_index;
-#endif
+	VkCommandPoolCreateInfo compute_pool_info = cmd_pool_info;
+	compute_pool_info.queueFamilyIndex = ctx.q_compute_index;
 
 	ctx.frames.resize(BUFFERED_FRAMES);
 	for (size_t i = 0; i < BUFFERED_FRAMES; ++i)
@@ -405,6 +435,7 @@ static void create_frame_resources(gpu_context_t& ctx)
 		VK_CHECK( vkCreateSemaphore(ctx.device, &sempahore_info, nullptr, &ctx.frames[i].present_semaphore) );
 		VK_CHECK( vkCreateFence(ctx.device, &fence_info, nullptr, &ctx.frames[i].fence) );
 		VK_CHECK( vkCreateCommandPool(ctx.device, &cmd_pool_info, nullptr, &ctx.frames[i].command_pool) );
+		VK_CHECK( vkCreateCommandPool(ctx.device, &compute_pool_info, nullptr, &ctx.frames[i].compute_command_pool) );
 
 		// Create command buffer
 		VkCommandBufferAllocateInfo buffer_info{};
@@ -414,6 +445,8 @@ static void create_frame_resources(gpu_context_t& ctx)
 		buffer_info.commandBufferCount = 1;
 
 		VK_CHECK( vkAllocateCommandBuffers(ctx.device, &buffer_info, &ctx.frames[i].command_buffer) );
+		buffer_info.commandPool = ctx.frames[i].compute_command_pool;
+		VK_CHECK( vkAllocateCommandBuffers(ctx.device, &buffer_info, &ctx.frames[i].compute_command_buffer) );
 	}
 	LOG_INFO("Frame resources created");
 }
@@ -756,6 +789,13 @@ bool create_buffer(gpu_context_t& ctx, u32 size, u32 usage, buffer_t* buffer, Vk
 	buffer_info.size = size;
 	buffer_info.queueFamilyIndexCount = 0;
 	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (ctx.queue_families.size() > 1)
+	{
+		// no ownership transfers between the graphics, compute and transfer queues
+		buffer_info.queueFamilyIndexCount = static_cast<u32>(ctx.queue_families.size());
+		buffer_info.pQueueFamilyIndices = ctx.queue_families.data();
+		buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+	}
 	buffer_info.flags = 0;
 	VK_CHECK( vkCreateBuffer(ctx.device, &buffer_info, nullptr, &buffer->handle) );
 
@@ -934,6 +974,7 @@ static void cleanup_swapchain(gpu_context_t& ctx)
 	for (size_t i = 0; i < ctx.frames.size(); ++i)
 	{
 		vkResetCommandPool(ctx.device, ctx.frames[i].command_pool, 0);
+		vkResetCommandPool(ctx.device, ctx.frames[i].compute_command_pool, 0);
 	}
 
 	// destroy graphics pipeline and default renderpass
@@ -980,6 +1021,7 @@ void destroy_context(gpu_context_t& ctx)
 		vkDestroySemaphore(ctx.device, ctx.frames[i].present_semaphore, nullptr);
 		vkDestroyFence(ctx.device, ctx.frames[i].fence, nullptr);
 		vkDestroyCommandPool(ctx.device, ctx.frames[i].command_pool, nullptr);
+		vkDestroyCommandPool(ctx.device, ctx.frames[i].compute_command_pool, nullptr);
 	}
 
 	ctx.allocator.destroy_allocator();// free memory
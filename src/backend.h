@@ -70,8 +70,10 @@ struct frame_t
 	VkFence         fence;
 	VkSemaphore     render_semaphore;
 	VkSemaphore     present_semaphore;
-	VkCommandPool   command_pool;
+	VkCommandPool   command_pool;   // graphics queue
 	VkCommandBuffer command_buffer;
+	VkCommandPool   compute_command_pool; // compute queue (light tree build)
+	VkCommandBuffer compute_command_buffer;
 	std::vector<VkDescriptorSet> descriptor_sets;
 };
 
@@ -101,6 +103,9 @@ struct gpu_context_t
     VkQueue                    q_compute;
 	VkQueue                    q_present;
 	VkQueue                    q_transfer;
+	bool                       q_graphics_timestamps; // family has timestampValidBits != 0
+	bool                       q_compute_timestamps;
+	std::vector<u32>           queue_families; // distinct families of the graphics, compute and transfer queue
 
 	swapchain_t                swapchain; 
 	image_t                    depth_buffer;
@@ -0,0 +1,136 @@
+#include "blue_noise.h"
+
+#include <cmath>
+#include <cfloat>
+
+#define BLUE_NOISE_SIGMA 1.5f // width of the gaussian that measures how clustered the texels are
+#define BLUE_NOISE_INITIAL_FRACTION 10 // 1 / fraction of the texels are set in the initial pattern
+
+struct void_and_cluster_t
+{
+    u32 size;
+    std::vector<f32> weights; // gaussian of the wrapped distance to texel 0
+    std::vector<f32> energy;  // sum of the weights of all set texels
+    std::vector<u8>  pattern;
+};
+
+static void toggle(void_and_cluster_t& vc, u32 texel)
+{
+    u32 size = vc.size;
+    u32 tx = texel % size;
+    u32 ty = texel / size;
+    f32 sign = vc.pattern[texel] ? -1.0f : 1.0f;
+    vc.pattern[texel] ^= 1;
+    for (u32 y = 0; y < size; ++y)
+    {
+        u32 dy = (y + size - ty) % size;
+        for (u32 x = 0; x < size; ++x)
+        {
+            u32 dx = (x + size - tx) % size;
+            vc.energy[y * size + x] += sign * vc.weights[dy * size + dx];
+        }
+    }
+}
+
+// set texel with the highest energy
+static u32 tightest_cluster(const void_and_cluster_t& vc)
+{
+    u32 best = 0;
+    f32 best_energy = -FLT_MAX;
+    for (u32 i = 0; i < vc.energy.size(); ++i)
+    {
+        if (vc.pattern[i] && vc.energy[i] > best_energy)
+        {
+            best = i;
+            best_energy = vc.energy[i];
+        }
+    }
+    return best;
+}
+
+// empty texel with the lowest energy
+static u32 largest_void(const void_and_cluster_t& vc)
+{
+    u32 best = 0;
+    f32 best_energy = FLT_MAX;
+    for (u32 i = 0; i < vc.energy.size(); ++i)
+    {
+        if (!vc.pattern[i] && vc.energy[i] < best_energy)
+        {
+            best = i;
+            best_energy = vc.energy[i];
+        }
+    }
+    return best;
+}
+
+void generate_blue_noise(u32 size, u32 seed, std::vector<f32>& values)
+{
+    u32 count = size * size;
+    void_and_cluster_t vc;
+    vc.size = size;
+    vc.weights.resize(count);
+    vc.energy.assign(count, 0.0f);
+    vc.pattern.assign(count, 0);
+    for (u32 y = 0; y < size; ++y)
+    {
+        for (u32 x = 0; x < size; ++x)
+        {
+            f32 dx = static_cast<f32>(x < size - x ? x : size - x);
+            f32 dy = static_cast<f32>(y < size - y ? y : size - y);
+            vc.weights[y * size + x] = expf(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+        }
+    }
+
+    // random initial pattern (xorshift), the texels are moved from the tightest cluster to
+    // the largest void until that does not change the pattern anymore
+    u32 initial = count / BLUE_NOISE_INITIAL_FRACTION;
+    u32 state = seed | 1;
+    for (u32 i = 0; i < initial;)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        u32 texel = state % count;
+        if (!vc.pattern[texel])
+        {
+            toggle(vc, texel);
+            i++;
+        }
+    }
+    for (u32 i = 0; i < count; ++i)
+    {
+        u32 cluster = tightest_cluster(vc);
+        toggle(vc, cluster);
+        u32 hole = largest_void(vc);
+        toggle(vc, hole);
+        if (hole == cluster)
+        {
+            break;
+        }
+    }
+
+    // rank of every texel: the set texels are removed from the tightest cluster down to rank 0,
+    // then the empty texels of the initial pattern are filled from the largest void
+    std::vector<u32> ranks(count);
+    void_and_cluster_t initial_pattern = vc;
+    for (u32 rank = initial; rank > 0; --rank)
+    {
+        u32 cluster = tightest_cluster(vc);
+        toggle(vc, cluster);
+        ranks[cluster] = rank - 1;
+    }
+    vc = initial_pattern;
+    for (u32 rank = initial; rank < count; ++rank)
+    {
+        u32 hole = largest_void(vc);
+        toggle(vc, hole);
+        ranks[hole] = rank;
+    }
+
+    values.resize(count);
+    for (u32 i = 0; i < count; ++i)
+    {
+        values[i] = (static_cast<f32>(ranks[i]) + 0.5f) / static_cast<f32>(count);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include "common.h"
+
+#include <vector>
+
+// tile of size x size blue noise values in [0, 1) generated with void and cluster (Ulichney 1993), every value
+// appears once and neighbouring texels have distant values. the tile wraps around so it can be repeated
+// over the screen (SAMPLER_BLUE_NOISE in shaders/sampler.inc)
+void generate_blue_noise(u32 size, u32 seed, std::vector<f32>& values);
+
+#endif // BLUE_NOISE_H
@@ -119,3 +119,12 @@ VkDescriptorSet build_descriptor_set(descriptor_allocator_t& allocator, descript
     return _set;
 }
 
+void update_descriptor_set(VkDevice device, descriptor_set_t& set, VkDescriptorSet handle)
+{
+    for (auto& write : set.writes)
+    {
+        write.dstSet = handle;
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<u32>(set.writes.size()), set.writes.data(), 0, nullptr);
+}
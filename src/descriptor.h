@@ -27,7 +27,7 @@ struct descriptor_allocator_t
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 100 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 100 },
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 100 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 100 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 200 }, // 50 per frame
 		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 50 },
 		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 50 },
 		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 50 },
@@ -52,5 +52,7 @@ void bind_buffer(descriptor_set_t& set, u32 binding, VkDescriptorBufferInfo* inf
 void bind_image(descriptor_set_t& set, u32 binding, VkDescriptorImageInfo* info);
 void bind_acceleration_structure(descriptor_set_t& set, u32 binding, VkAccelerationStructureKHR* acceleration_struture);
 VkDescriptorSet build_descriptor_set(descriptor_allocator_t& allocator, descriptor_set_t& set);
+// writes the bindings into an already allocated set (set must not be in use)
+void update_descriptor_set(VkDevice device, descriptor_set_t& set, VkDescriptorSet handle);
 
 #endif
@@ -2,6 +2,18 @@
 #include "log.h"
 
 #include <stdio.h>
+#include <string>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 i32 read_file(const char* path, file_contents_t* out)
 {
@@ -37,3 +49,99 @@ i32 read_file(const char* path, file_contents_t* out)
     fclose(fp);
     return bytes;
 }
+
+bool map_file(const char* path, mapped_file_t* out)
+{
+    if (!out) return false;
+    *out = {};
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data)
+    {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        LOG_ERROR("Could not map the file %s", path);
+        return false;
+    }
+    out->file = file;
+    out->mapping = mapping;
+    out->size = static_cast<size_t>(size.QuadPart);
+#else
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (data == MAP_FAILED)
+    {
+        LOG_ERROR("Could not map the file %s", path);
+        return false;
+    }
+    out->size = static_cast<size_t>(st.st_size);
+#endif
+    out->contents = static_cast<const u8*>(data);
+    return true;
+}
+
+void unmap_file(mapped_file_t* file)
+{
+    if (!file || !file->contents) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(file->contents);
+    CloseHandle(file->mapping);
+    CloseHandle(file->file);
+#else
+    munmap(const_cast<u8*>(file->contents), file->size);
+#endif
+    *file = {};
+}
+
+bool write_file(const char* path, const void* data, size_t size)
+{
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp)
+    {
+        LOG_ERROR("Could not open file %s for writing", tmp_path.c_str());
+        return false;
+    }
+    size_t bytes = fwrite(data, 1, size, fp);
+    fclose(fp);
+    if (bytes != size)
+    {
+        LOG_ERROR("Could not write the file %s, wrote %zu bytes out of the %zu bytes", tmp_path.c_str(), bytes, size);
+        remove(tmp_path.c_str());
+        return false;
+    }
+#if defined(_WIN32)
+    remove(path); // rename does not replace existing files on windows
+#endif
+    if (rename(tmp_path.c_str(), path) != 0)
+    {
+        LOG_ERROR("Could not replace the file %s", path);
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
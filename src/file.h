@@ -13,4 +13,22 @@ struct file_contents_t
 
 i32 read_file(const char* path, file_contents_t* out);
 
+// read only view of a file mapped into memory
+struct mapped_file_t
+{
+    const u8* contents = nullptr;
+    size_t    size = 0;
+#if defined(_WIN32)
+    void*     file = nullptr;
+    void*     mapping = nullptr;
+#endif
+};
+
+// returns false if the file does not exist or is empty
+bool map_file(const char* path, mapped_file_t* out);
+void unmap_file(mapped_file_t* file);
+
+// replaces the file (written to path.tmp first so a crash never leaves a half written file)
+bool write_file(const char* path, const void* data, size_t size);
+
 #endif // FILE_H
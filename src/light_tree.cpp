@@ -0,0 +1,1489 @@
+#include "light_tree.h"
+#include "file.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#define INVALID_ID 0xffffffff // same as shaders/common.inc
+
+// same as shaders/light_tree_quant.inc
+static f32 dequantize(u32 q, f32 parent_min, f32 parent_max)
+{
+    f32 v = parent_min + static_cast<f32>(q) * ((parent_max - parent_min) / static_cast<f32>(LIGHT_TREE_QUANT_MAX));
+    return q == static_cast<u32>(LIGHT_TREE_QUANT_MAX) ? parent_max : v;
+}
+
+// largest cell boundary <= v
+static u32 quantize_min(f32 v, f32 parent_min, f32 parent_max)
+{
+    f32 extent = parent_max - parent_min;
+    u32 q = 0;
+    if (extent > 0)
+    {
+        q = static_cast<u32>(clamp((v - parent_min) / extent * static_cast<f32>(LIGHT_TREE_QUANT_MAX), 0.0f, 
+                    static_cast<f32>(LIGHT_TREE_QUANT_MAX)));
+    }
+    while (q > 0 && dequantize(q, parent_min, parent_max) > v)
+    {
+        q--;
+    }
+    return q;
+}
+
+// smallest cell boundary >= v
+static u32 quantize_max(f32 v, f32 parent_min, f32 parent_max)
+{
+    f32 extent = parent_max - parent_min;
+    u32 q = 0;
+    if (extent > 0)
+    {
+        q = static_cast<u32>(clamp(ceilf((v - parent_min) / extent * static_cast<f32>(LIGHT_TREE_QUANT_MAX)), 0.0f, 
+                    static_cast<f32>(LIGHT_TREE_QUANT_MAX)));
+    }
+    while (q < static_cast<u32>(LIGHT_TREE_QUANT_MAX) && dequantize(q, parent_min, parent_max) < v)
+    {
+        q++;
+    }
+    return q;
+}
+
+static quant_node_t encode_quant_node(const node_t& node, const v3& parent_min, const v3& parent_max)
+{
+    quant_node_t quant;
+    quant.intensity = node.intensity;
+    quant.id = node.id;
+    quant.bbox_min = 0;
+    quant.bbox_max = 0;
+    if (node.intensity > 0) // bounds of empty nodes are not used
+    {
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 shift = k * LIGHT_TREE_QUANT_BITS;
+            quant.bbox_min |= quantize_min(node.bbox_min.data[k], parent_min.data[k], parent_max.data[k]) << shift;
+            quant.bbox_max |= quantize_max(node.bbox_max.data[k], parent_min.data[k], parent_max.data[k]) << shift;
+        }
+    }
+    return quant;
+}
+
+static void decode_quant_bounds(const quant_node_t& node, const v3& parent_min, const v3& parent_max, v3& bbox_min, v3& bbox_max)
+{
+    v3 _min;
+    v3 _max;
+    for (u32 k = 0; k < 3; k++)
+    {
+        u32 shift = k * LIGHT_TREE_QUANT_BITS;
+        _min.data[k] = dequantize((node.bbox_min >> shift) & LIGHT_TREE_QUANT_MAX, parent_min.data[k], parent_max.data[k]);
+        _max.data[k] = dequantize((node.bbox_max >> shift) & LIGHT_TREE_QUANT_MAX, parent_min.data[k], parent_max.data[k]);
+    }
+    bbox_min = _min;
+    bbox_max = _max;
+}
+
+static inline u32 get_msb(u32 v)
+{
+    u32 msb = 0;
+    while (v >>= 1)
+    {
+        msb++;
+    }
+    return msb;
+}
+
+// array index of a node from its id in breadth first order (root = 0)
+static inline u32 get_array_index(u32 id, u32 num_nodes)
+{
+    u32 level = get_msb(id + 1);
+    return id - ((1 << level) - 1) + num_nodes + 1 - (1 << (level + 1));
+}
+
+u32 count_unbounded_lights(const node_t& root, const quant_node_t* quant_nodes, u32 num_nodes, const std::vector<light_t>& lights)
+{
+    struct entry_t
+    {
+        u32 id;
+        v3  bbox_min;
+        v3  bbox_max;
+    };
+
+    u32 num_inner_nodes = num_nodes / 2;
+    u32 count = 0;
+    std::vector<entry_t> stack;
+    stack.push_back({ 0, root.bbox_min, root.bbox_max });
+    while (!stack.empty())
+    {
+        entry_t e = stack.back();
+        stack.pop_back();
+
+        const quant_node_t& node = quant_nodes[get_array_index(e.id, num_nodes)];
+        if (node.intensity <= 0)
+        {
+            continue; // empty subtree
+        }
+        if (e.id >= num_inner_nodes)
+        {
+            if (node.id >= lights.size())
+            {
+                count++;
+                continue;
+            }
+            v3 p = lights[node.id].pos.xyz;
+            for (u32 k = 0; k < 3; k++)
+            {
+                if (p.data[k] < e.bbox_min.data[k] || p.data[k] > e.bbox_max.data[k])
+                {
+                    count++;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        for (u32 c = 1; c <= 2; c++)
+        {
+            entry_t child;
+            child.id = 2 * e.id + c;
+            decode_quant_bounds(quant_nodes[get_array_index(child.id, num_nodes)], e.bbox_min, e.bbox_max, child.bbox_min, child.bbox_max);
+            stack.push_back(child);
+        }
+    }
+    return count;
+}
+
+// same as merge_cones in shaders/common.inc
+static void merge_cones(v3 axis_a, f32 angle_a, v3 axis_b, f32 angle_b, v3& axis, f32& angle)
+{
+    if (angle_b > angle_a)
+    {
+        std::swap(axis_a, axis_b);
+        std::swap(angle_a, angle_b);
+    }
+    axis = axis_a;
+    angle = angle_a;
+    if (angle_a >= PI)
+    {
+        return; // point lights, skips the trigonometry in the builder
+    }
+    f32 angle_d = acosf(clamp(dot(axis_a, axis_b), -1.0f, 1.0f));
+    if (MIN(angle_d + angle_b, static_cast<f32>(PI)) <= angle_a)
+    {
+        return;
+    }
+    f32 angle_o = (angle_a + angle_d + angle_b) * 0.5f;
+    if (angle_o >= PI)
+    {
+        angle = PI;
+        return;
+    }
+    v3 ortho = axis_b - axis_a * dot(axis_a, axis_b);
+    if (dot(ortho, ortho) < 1e-12f)
+    {
+        ortho = fabsf(axis_a.x) < 0.9f ? cross(axis_a, vec3(1, 0, 0)) : cross(axis_a, vec3(0, 1, 0));
+    }
+    f32 angle_r = angle_o - angle_a;
+    axis = normalize(axis_a * cosf(angle_r) + normalize(ortho) * sinf(angle_r));
+    angle = angle_o;
+}
+
+// same as create_leaf_node and merge_nodes in shaders/light_tree.inc
+static node_t create_leaf_node(const std::vector<light_t>& lights, u32 idx)
+{
+    node_t node;
+    node.id = idx;
+    node.intensity = 0.0f;
+    node.bbox_min = vec3(FLT_MIN);
+    node.bbox_max = vec3(FLT_MAX);
+    node.cone_axis = vec3(0, -1, 0);
+    node.cone_angle = 0.0f;
+    if (idx != INVALID_ID)
+    {
+        const light_t& light = lights[idx];
+        node.intensity = light.color.x + light.color.y + light.color.z;
+        node.cone_axis = light.direction;
+        node.cone_angle = MIN(light.cone_angle, static_cast<f32>(PI));
+        if (node.intensity > 0)
+        {
+            node.bbox_min = light.pos.xyz;
+            node.bbox_max = light.pos.xyz;
+        }
+    }
+    return node;
+}
+
+static node_t merge_nodes(const node_t& n0, const node_t& n1)
+{
+    if (n0.intensity <= 0)
+    {
+        return n1;
+    }
+    node_t node = n0;
+    if (n1.intensity > 0)
+    {
+        node.intensity += n1.intensity;
+        node.bbox_min = min(node.bbox_min, n1.bbox_min);
+        node.bbox_max = max(node.bbox_max, n1.bbox_max);
+        merge_cones(node.cone_axis, node.cone_angle, n1.cone_axis, n1.cone_angle, node.cone_axis, node.cone_angle);
+    }
+    return node;
+}
+
+/*
+ * Top down builder of a binary tree in the lbvh layout (LIGHT_TREE_TYPE_LBVH). An inner node 
+ * that covers the sorted lights [first, last] and is split after light s stores s in its id, 
+ * its children are the inner nodes s and s + 1 or the leaf nodes n - 1 + s and n + s. 
+ * This gives every inner node a unique index for any split, not just for the morton splits.
+ */
+#define SAOH_BINS 12
+#define BUILD_TASK_MIN_LIGHTS 4096 // smaller subtrees are built by the thread of their parent
+
+enum split_mode_t
+{
+    SPLIT_SAOH,   // binned surface area orientation heuristic
+    SPLIT_MORTON, // lights are sorted by their morton code, same splits as the complete tree
+};
+
+// compact copy of a light for the saoh splits, the copies are partitioned instead of indices 
+// into the lights so the bins are filled from contiguous memory
+struct build_light_t
+{
+    v3  pos;
+    f32 energy;
+    v3  direction;
+    f32 cone_angle;
+    u32 id;
+};
+
+struct tree_builder_t
+{
+    const std::vector<light_t>* lights;
+    std::vector<u32> order; // SPLIT_MORTON: sorted lights, leaf node i = order[i]
+    std::vector<build_light_t> build_lights; // SPLIT_SAOH: leaf node i = build_lights[i].id
+    std::vector<node_t> nodes;
+    split_mode_t mode;
+    u32 task_depth; // subtrees above this depth can be built by a new thread
+};
+
+// light of the i'th leaf node
+static u32 sorted_light(const tree_builder_t& builder, u32 i)
+{
+    return builder.mode == SPLIT_SAOH ? builder.build_lights[i].id : builder.order[i];
+}
+
+struct bounds_t
+{
+    v3 bbox_min = vec3(FLT_MAX);
+    v3 bbox_max = vec3(-FLT_MAX);
+    v3 cone_axis = vec3(0, -1, 0);
+    f32 cone_angle = 0.0f;
+    f32 energy = 0.0f;
+    u32 count = 0;
+
+    // lights added one by one only sum their directions, see fit_cone
+    v3 direction_sum = vec3(0);
+    f32 max_cone_angle = 0.0f;
+    f32 min_cos = 1.0f;
+};
+
+static void grow(bounds_t& b, const build_light_t& light)
+{
+    b.bbox_min = min(b.bbox_min, light.pos);
+    b.bbox_max = max(b.bbox_max, light.pos);
+    b.direction_sum += light.direction;
+    b.max_cone_angle = MAX(b.max_cone_angle, light.cone_angle);
+    b.energy += light.energy;
+    b.count++;
+}
+
+// bounding cone around the mean direction of the lights added with grow, cheaper than merging 
+// the cone of every light (only used for the cost, the nodes merge the exact cones). 
+// call fit_cone_axis, then bound_direction for all lights and then fit_cone
+static void fit_cone_axis(bounds_t& b)
+{
+    f32 len2 = dot(b.direction_sum, b.direction_sum);
+    b.cone_axis = len2 > 1e-12f ? b.direction_sum / sqrtf(len2) : vec3(0, -1, 0);
+}
+
+static void bound_direction(bounds_t& b, const build_light_t& light)
+{
+    b.min_cos = MIN(b.min_cos, dot(b.cone_axis, light.direction));
+}
+
+static void fit_cone(bounds_t& b)
+{
+    if (b.max_cone_angle >= PI)
+    {
+        b.cone_angle = PI;
+        return;
+    }
+    b.cone_angle = MIN(acosf(clamp(b.min_cos, -1.0f, 1.0f)) + b.max_cone_angle, static_cast<f32>(PI));
+}
+
+static void grow(bounds_t& b, const bounds_t& o)
+{
+    if (o.count == 0)
+    {
+        return;
+    }
+    b.bbox_min = min(b.bbox_min, o.bbox_min);
+    b.bbox_max = max(b.bbox_max, o.bbox_max);
+    if (b.count == 0)
+    {
+        b.cone_axis = o.cone_axis;
+        b.cone_angle = o.cone_angle;
+    }
+    else if (b.cone_angle < PI)
+    {
+        merge_cones(b.cone_axis, b.cone_angle, o.cone_axis, o.cone_angle, b.cone_axis, b.cone_angle);
+    }
+    b.energy += o.energy;
+    b.count += o.count;
+}
+
+// orientation measure of the bounding cone (Conty and Kulla 2018) assuming a cosine emission 
+// around every direction of the cone (theta_e = pi/2), 4pi for point lights
+static f32 orientation_measure(const bounds_t& b)
+{
+    if (b.cone_angle >= PI)
+    {
+        return 4.0f * PI;
+    }
+    f32 theta_o = b.cone_angle;
+    f32 theta_w = MIN(theta_o + 0.5f * static_cast<f32>(PI), static_cast<f32>(PI));
+    f32 sin_o = sinf(theta_o);
+    f32 cos_o = cosf(theta_o);
+    return 2.0f * PI * (1.0f - cos_o) 
+        + 0.5f * PI * (2.0f * theta_w * sin_o - cosf(theta_o - 2.0f * theta_w) - 2.0f * theta_o * sin_o + cos_o);
+}
+
+// surface area of the bounds, every side is at least min_extent so that points and planar 
+// clusters of lights are not free
+static f32 surface_area(const bounds_t& b, f32 min_extent)
+{
+    v3 d = max(b.bbox_max - b.bbox_min, vec3(min_extent));
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// returns the number of lights in the left child, the lights in [first, first + count) are reordered
+static u32 split_saoh(tree_builder_t& builder, u32 first, u32 count)
+{
+    build_light_t* begin = builder.build_lights.data() + first;
+
+    bounds_t parent;
+    for (u32 i = 0; i < count; i++)
+    {
+        grow(parent, begin[i]);
+    }
+    v3 extent = parent.bbox_max - parent.bbox_min;
+    f32 max_extent = MAX(extent.x, MAX(extent.y, extent.z));
+    if (max_extent <= 0.0f)
+    {
+        return count / 2; // all lights at the same position
+    }
+    f32 min_extent = max_extent * 1e-3f;
+
+    // cost = energy * surface area * orientation measure of both children, the regularization 
+    // factor max_extent / extent favours splits along the long axes (thin nodes)
+    f32 best_cost = FLT_MAX;
+    u32 best_axis = 0;
+    u32 best_bin = 0;
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        if (extent.data[axis] <= 0.0f)
+        {
+            continue;
+        }
+        f32 scale = SAOH_BINS / extent.data[axis];
+        auto get_bin = [&](const build_light_t& light)
+            {
+                return MIN(static_cast<u32>((light.pos.data[axis] - parent.bbox_min.data[axis]) * scale), SAOH_BINS - 1u);
+            };
+        bounds_t bins[SAOH_BINS];
+        for (u32 i = 0; i < count; i++)
+        {
+            grow(bins[get_bin(begin[i])], begin[i]);
+        }
+        if (parent.max_cone_angle < PI)
+        {
+            for (u32 b = 0; b < SAOH_BINS; b++)
+            {
+                fit_cone_axis(bins[b]);
+            }
+            for (u32 i = 0; i < count; i++)
+            {
+                bound_direction(bins[get_bin(begin[i])], begin[i]);
+            }
+        }
+        for (u32 b = 0; b < SAOH_BINS; b++)
+        {
+            fit_cone(bins[b]); // point lights (min_cos = 1, max_cone_angle = PI)
+        }
+
+        // right side swept from the back
+        f32 right_cost[SAOH_BINS];
+        bounds_t right;
+        for (u32 b = SAOH_BINS - 1; b > 0; b--)
+        {
+            grow(right, bins[b]);
+            right_cost[b] = right.count > 0 ? right.energy * surface_area(right, min_extent) * orientation_measure(right) : 0.0f;
+        }
+
+        f32 regularization = max_extent / extent.data[axis];
+        bounds_t left;
+        for (u32 b = 0; b < SAOH_BINS - 1; b++)
+        {
+            grow(left, bins[b]);
+            if (left.count == 0 || left.count == count)
+            {
+                continue;
+            }
+            f32 cost = regularization * (left.energy * surface_area(left, min_extent) * orientation_measure(left) + right_cost[b + 1]);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+    if (best_cost == FLT_MAX)
+    {
+        return count / 2;
+    }
+
+    f32 scale = SAOH_BINS / extent.data[best_axis];
+    f32 origin = parent.bbox_min.data[best_axis];
+    build_light_t* mid = std::partition(begin, begin + count, [&](const build_light_t& light)
+            { 
+                f32 v = light.pos.data[best_axis];
+                return MIN(static_cast<u32>((v - origin) * scale), SAOH_BINS - 1u) <= best_bin; 
+            });
+    return static_cast<u32>(mid - begin);
+}
+
+// builds the subtree of the lights [first, first + count) into nodes[index] (count > 1)
+static void build_subtree(tree_builder_t& builder, u32 index, u32 first, u32 count, u32 depth)
+{
+    u32 n = static_cast<u32>(builder.lights->size());
+    u32 left_count;
+    if (builder.mode == SPLIT_SAOH)
+    {
+        left_count = split_saoh(builder, first, count);
+    }
+    else
+    {
+        // the largest power of 2 below count, the empty subtrees of the complete tree are skipped
+        u32 pow2 = 1;
+        while (pow2 * 2 < count)
+        {
+            pow2 <<= 1;
+        }
+        left_count = pow2;
+    }
+
+    u32 split = first + left_count - 1;
+    u32 right_count = count - left_count;
+    u32 left = left_count == 1 ? n - 1 + split : split;
+    u32 right = right_count == 1 ? n + split : split + 1;
+
+    // large subtrees of the upper levels are built in parallel (they write disjoint nodes)
+    std::future<void> task;
+    if (left_count > 1)
+    {
+        if (depth < builder.task_depth && left_count >= BUILD_TASK_MIN_LIGHTS)
+        {
+            task = std::async(std::launch::async, build_subtree, std::ref(builder), left, first, left_count, depth + 1);
+        }
+        else
+        {
+            build_subtree(builder, left, first, left_count, depth + 1);
+        }
+    }
+    else
+    {
+        builder.nodes[left] = create_leaf_node(*builder.lights, sorted_light(builder, first));
+    }
+    if (right_count > 1)
+    {
+        build_subtree(builder, right, split + 1, right_count, depth + 1);
+    }
+    else
+    {
+        builder.nodes[right] = create_leaf_node(*builder.lights, sorted_light(builder, split + 1));
+    }
+    if (task.valid())
+    {
+        task.wait();
+    }
+
+    node_t node = merge_nodes(builder.nodes[left], builder.nodes[right]);
+    node.id = split 
+        | (left_count == 1 ? LBVH_LEFT_LEAF_BIT : 0u) 
+        | (right_count == 1 ? LBVH_RIGHT_LEAF_BIT : 0u);
+    builder.nodes[index] = node;
+}
+
+static void build_tree(tree_builder_t& builder)
+{
+    u32 n = static_cast<u32>(builder.lights->size());
+    builder.task_depth = get_msb(MAX(std::thread::hardware_concurrency(), 1u)) + 1;
+    builder.nodes.resize(2 * n - 1);
+    if (n == 1)
+    {
+        builder.nodes[0] = create_leaf_node(*builder.lights, sorted_light(builder, 0));
+        return;
+    }
+    build_subtree(builder, 0, 0, n, 0);
+}
+
+void build_light_tree_saoh(const std::vector<light_t>& lights, std::vector<node_t>& nodes)
+{
+    nodes.clear();
+    if (lights.empty())
+    {
+        return;
+    }
+
+    tree_builder_t builder;
+    builder.lights = &lights;
+    builder.mode = SPLIT_SAOH;
+    builder.build_lights.resize(lights.size());
+    for (u32 i = 0; i < builder.build_lights.size(); i++)
+    {
+        const light_t& light = lights[i];
+        build_light_t& b = builder.build_lights[i];
+        b.pos = light.pos.xyz;
+        b.energy = light.color.x + light.color.y + light.color.z;
+        b.direction = light.direction;
+        b.cone_angle = MIN(light.cone_angle, static_cast<f32>(PI));
+        b.id = i;
+    }
+    build_tree(builder);
+    nodes = std::move(builder.nodes);
+}
+
+#define LIGHT_TREE_CACHE_MAGIC 0x4354484cu // "LHTC"
+
+struct light_tree_cache_header_t
+{
+    u32 magic;
+    u32 version;   // LIGHT_TREE_CACHE_VERSION
+    u32 node_size; // sizeof(node_t), changes with the node layout in shader_data.h
+    u32 num_lights;
+    u64 lights_hash;
+    u32 num_nodes;
+    u32 padding;
+};
+
+// fnv-1a over the light data (position, color and emission cone)
+u64 hash_lights(const std::vector<light_t>& lights)
+{
+    u64 hash = 0xcbf29ce484222325ull;
+    const u8* bytes = reinterpret_cast<const u8*>(lights.data());
+    size_t size = sizeof(light_t) * lights.size();
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool load_light_tree_cache(const char* path, u64 lights_hash, u32 num_lights, std::vector<node_t>& nodes)
+{
+    mapped_file_t file;
+    if (num_lights == 0 || !map_file(path, &file))
+    {
+        return false;
+    }
+
+    light_tree_cache_header_t header;
+    bool valid = file.size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, file.contents, sizeof(header));
+        valid = header.magic == LIGHT_TREE_CACHE_MAGIC 
+            && header.version == LIGHT_TREE_CACHE_VERSION
+            && header.node_size == sizeof(node_t)
+            && header.num_lights == num_lights
+            && header.lights_hash == lights_hash
+            && header.num_nodes == 2 * num_lights - 1
+            && file.size == sizeof(header) + sizeof(node_t) * header.num_nodes;
+    }
+    if (valid)
+    {
+        nodes.resize(header.num_nodes);
+        memcpy(nodes.data(), file.contents + sizeof(header), sizeof(node_t) * header.num_nodes);
+
+        // leaf ids index into the lights buffer on the gpu, do not trust a damaged file
+        for (u32 i = num_lights - 1; i < header.num_nodes && valid; i++)
+        {
+            valid = nodes[i].id < num_lights;
+        }
+    }
+    unmap_file(&file);
+
+    if (!valid)
+    {
+        nodes.clear();
+        LOG_INFO("Light tree cache %s is stale, rebuilding the tree", path);
+    }
+    return valid;
+}
+
+bool save_light_tree_cache(const char* path, u64 lights_hash, u32 num_lights, const std::vector<node_t>& nodes)
+{
+    if (num_lights == 0 || nodes.size() != 2 * num_lights - 1)
+    {
+        return false;
+    }
+
+    light_tree_cache_header_t header = {};
+    header.magic = LIGHT_TREE_CACHE_MAGIC;
+    header.version = LIGHT_TREE_CACHE_VERSION;
+    header.node_size = sizeof(node_t);
+    header.num_lights = num_lights;
+    header.lights_hash = lights_hash;
+    header.num_nodes = static_cast<u32>(nodes.size());
+
+    std::vector<u8> data(sizeof(header) + sizeof(node_t) * nodes.size());
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), nodes.data(), sizeof(node_t) * nodes.size());
+    return write_file(path, data.data(), data.size());
+}
+
+// same as shaders/morton_encode.comp
+static u64 bit_expansion(u32 x)
+{
+    u64 v = x & 0x1fffffu;
+    v = (v | (v << 32)) & 0x001f00000000ffffull;
+    v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+    v = (v | (v << 8))  & 0x100f00f00f00f00full;
+    v = (v | (v << 4))  & 0x10c30c30c30c30c3ull;
+    v = (v | (v << 2))  & 0x1249249249249249ull;
+    return v;
+}
+
+// same as hue_bucket and octant in shaders/morton_encode.comp
+static u32 hue_bucket(v3 c)
+{
+    f32 c_max = MAX(c.x, MAX(c.y, c.z));
+    f32 d = c_max - MIN(c.x, MIN(c.y, c.z));
+    if (d <= 1e-6f)
+    {
+        return 0;
+    }
+    f32 h;
+    if (c_max == c.x)      h = fmodf((c.y - c.z) / d + 6.0f, 6.0f);
+    else if (c_max == c.y) h = (c.z - c.x) / d + 2.0f;
+    else                   h = (c.x - c.y) / d + 4.0f;
+    return MIN(static_cast<u32>(h / 6.0f * (1 << MORTON_ATTRIBUTE_BITS)), (1u << MORTON_ATTRIBUTE_BITS) - 1);
+}
+
+static u32 octant(const light_t& light)
+{
+    v3 d = light.cone_angle < LIGHT_CONE_OMNI ? light.direction : vec3(0, -1, 0);
+    return static_cast<u32>(d.x > 0) | (static_cast<u32>(d.y > 0) << 1) | (static_cast<u32>(d.z > 0) << 2);
+}
+
+// lights sorted by their morton code (same order as the gpu sort)
+static void sort_lights_morton(const std::vector<light_t>& lights, u32 key_mode, std::vector<u32>& order)
+{
+    u32 n = static_cast<u32>(lights.size());
+    v3 bbox_min = vec3(FLT_MAX);
+    v3 bbox_max = vec3(-FLT_MAX);
+    for (const auto& light : lights)
+    {
+        bbox_min = min(bbox_min, light.pos.xyz);
+        bbox_max = max(bbox_max, light.pos.xyz);
+    }
+    v3 dims = bbox_max - bbox_min;
+
+    std::vector<u64> codes(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        u32 q[3];
+        for (u32 k = 0; k < 3; k++)
+        {
+            f32 v = dims.data[k] > 0.0f ? (lights[i].pos.data[k] - bbox_min.data[k]) / dims.data[k] : 0.0f;
+            q[k] = static_cast<u32>(MIN(MAX(v * 2097152.0f, 0.0f), 2097151.0f));
+        }
+        if (key_mode == MORTON_KEY_POSITION)
+        {
+            codes[i] = (bit_expansion(q[2]) << 2) | (bit_expansion(q[1]) << 1) | bit_expansion(q[0]);
+            continue;
+        }
+
+        u64 spatial = (bit_expansion(q[2] >> 1) << 2) | (bit_expansion(q[1] >> 1) << 1) | bit_expansion(q[0] >> 1);
+        u32 attribute = key_mode == MORTON_KEY_COLOR ? hue_bucket(lights[i].color.xyz) : octant(lights[i]);
+        u64 code = 0;
+        for (u32 level = 0; level < MORTON_ATTRIBUTE_BITS; level++)
+        {
+            u64 cell = (spatial >> (57 - 3 * level)) & 7;
+            u64 bit = (attribute >> (MORTON_ATTRIBUTE_BITS - 1 - level)) & 1;
+            code = (code << 4) | (cell << 1) | bit;
+        }
+        codes[i] = (code << 51) | (spatial & ((1ull << 51) - 1));
+    }
+
+    order.resize(n);
+    for (u32 i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return codes[a] < codes[b]; });
+}
+
+static void build_light_tree_morton(const std::vector<light_t>& lights, std::vector<node_t>& nodes, u32 key_mode)
+{
+    tree_builder_t builder;
+    builder.lights = &lights;
+    builder.mode = SPLIT_MORTON;
+    sort_lights_morton(lights, key_mode, builder.order);
+    build_tree(builder);
+    nodes = std::move(builder.nodes);
+}
+
+// same as the gpu build of LIGHT_TREE_TYPE_COMPLETE: the sorted lights padded with dummy nodes to a power of 
+// two are the leaf nodes at [0, num_leaf_nodes), the levels above follow up to the root at the end of the array
+static void build_light_tree_complete(const std::vector<light_t>& lights, std::vector<node_t>& nodes)
+{
+    std::vector<u32> order;
+    sort_lights_morton(lights, MORTON_KEY_POSITION, order);
+    u32 num_leaf_nodes = MAX(next_pow2(static_cast<u32>(lights.size())), 2u);
+    u32 num_nodes = 2 * num_leaf_nodes - 1;
+    nodes.resize(num_nodes);
+    for (u32 i = 0; i < num_leaf_nodes; i++)
+    {
+        nodes[i] = create_leaf_node(lights, i < order.size() ? order[i] : INVALID_ID);
+    }
+    for (u32 id = num_leaf_nodes - 1; id-- > 0;)
+    {
+        u32 idx = get_array_index(id, num_nodes);
+        nodes[idx] = merge_nodes(nodes[get_array_index(2 * id + 1, num_nodes)], nodes[get_array_index(2 * id + 2, num_nodes)]);
+        nodes[idx].id = idx;
+    }
+}
+
+// same as shaders/light_tree_quant.comp, the bounds of the parent are decoded from the root down
+static void build_quant_tree(const std::vector<node_t>& nodes, std::vector<quant_node_t>& quant_nodes)
+{
+    u32 num_nodes = static_cast<u32>(nodes.size());
+    const node_t& root = nodes[num_nodes - 1];
+    quant_nodes.resize(num_nodes);
+    for (u32 id = 0; id < num_nodes; id++)
+    {
+        v3 parent_min = root.bbox_min;
+        v3 parent_max = root.bbox_max;
+        u32 level = get_msb(id + 1);
+        for (u32 l = 1; l < level; l++)
+        {
+            u32 ancestor = ((id + 1) >> (level - l)) - 1;
+            quant_node_t quant = encode_quant_node(nodes[get_array_index(ancestor, num_nodes)], parent_min, parent_max);
+            decode_quant_bounds(quant, parent_min, parent_max, parent_min, parent_max);
+        }
+        quant_nodes[get_array_index(id, num_nodes)] = encode_quant_node(nodes[get_array_index(id, num_nodes)], parent_min, parent_max);
+    }
+}
+
+static inline v3 mul(const v3& l, const v3& r)
+{
+    return vec3(l.x * r.x, l.y * r.y, l.z * r.z);
+}
+
+static inline v3 abs(const v3& v)
+{
+    return vec3(fabsf(v.x), fabsf(v.y), fabsf(v.z));
+}
+
+// same as shaders/lightcuts.inc
+static f32 squared_min_distance(v3 p, v3 bbox_min, v3 bbox_max)
+{
+    v3 d = min(max(bbox_min, p), bbox_max) - p;
+    return dot(d, d);
+}
+
+static f32 squared_max_distance(v3 p, v3 bbox_min, v3 bbox_max)
+{
+    v3 d = max(abs(bbox_min - p), abs(bbox_max - p));
+    return dot(d, d);
+}
+
+static f32 geometric_term(v3 p, v3 normal, v3 bbox_min, v3 bbox_max)
+{
+    v3 b0 = mul(normal, bbox_min - p);
+    v3 b1 = mul(normal, bbox_max - p);
+    v3 pz = max(b0, b1);
+    f32 max_pz = pz.x + pz.y + pz.z;
+    if (max_pz <= 0) return 0;
+    v3 d = min(max(bbox_min, p), bbox_max) - p;
+    v3 tng = d - dot(d, normal) * normal;
+    return max_pz / sqrtf(dot(tng, tng) + max_pz * max_pz);
+}
+
+static f32 orientation_bound(v3 p, const node_t& node)
+{
+    if (node.cone_angle >= PI) return 1.0f;
+    v3 center = (node.bbox_min + node.bbox_max) * 0.5f;
+    v3 extent = (node.bbox_max - node.bbox_min) * 0.5f;
+    v3 d = p - center;
+    f32 dist2 = dot(d, d);
+    f32 radius2 = dot(extent, extent);
+    if (dist2 <= radius2) return 1.0f;
+    f32 theta = acosf(clamp(dot(node.cone_axis, d) / sqrtf(dist2), -1.0f, 1.0f));
+    f32 theta_u = asinf(sqrtf(radius2 / dist2));
+    return theta - theta_u <= node.cone_angle + 1e-3f ? 1.0f : 0.0f;
+}
+
+static f32 oriented_intensity(const node_t& node, v3 p)
+{
+    return node.intensity > 0 ? node.intensity * orientation_bound(p, node) : 0.0f;
+}
+
+// same as spot_falloff in shaders/common.inc
+static f32 spot_falloff(v3 direction, f32 cone_angle, v3 L)
+{
+    if (cone_angle >= PI) return 1.0f;
+    f32 lo = cosf(cone_angle);
+    f32 hi = cosf(cone_angle * 0.9f);
+    f32 t = clamp((dot(direction, -1.0f * L) - lo) / (hi - lo), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static f32 child_probability(v3 p, v3 normal, const node_t& node0, const node_t& node1)
+{
+    // only the intensity towards p is used (as in select_lights)
+    node_t n0 = node0;
+    node_t n1 = node1;
+    n0.intensity = oriented_intensity(node0, p);
+    n1.intensity = oriented_intensity(node1, p);
+    if (n0.intensity + n1.intensity == 0) return -1.0f;
+    if (n0.intensity == 0) return 0.0f;
+    if (n1.intensity == 0) return 1.0f;
+
+    f32 g0 = geometric_term(p, normal, n0.bbox_min, n0.bbox_max);
+    f32 g1 = geometric_term(p, normal, n1.bbox_min, n1.bbox_max);
+    if (g0 + g1 == 0.0f) return -1.0f;
+
+    // the min distance is clamped for points inside of the bounds (as in wide_child_probabilities)
+    f32 gi0 = g0 * n0.intensity;
+    f32 w0_min = gi0 / MAX(squared_min_distance(p, n0.bbox_min, n0.bbox_max), 1e-8f);
+    f32 w0_max = gi0 / squared_max_distance(p, n0.bbox_min, n0.bbox_max);
+    f32 gi1 = g1 * n1.intensity;
+    f32 w1_min = gi1 / MAX(squared_min_distance(p, n1.bbox_min, n1.bbox_max), 1e-8f);
+    f32 w1_max = gi1 / squared_max_distance(p, n1.bbox_min, n1.bbox_max);
+
+    f32 prob_c0_max = w0_max / (w0_max + w1_max);
+    f32 prob_c0_min = w0_min + w1_min == 0.0f ? gi0 / (gi0 + gi1) : w0_min / (w0_min + w1_min);
+    return (prob_c0_min + prob_c0_max) * 0.5f;
+}
+
+static_assert((1 << (CUT_BENCHMARK_SIZES - 1)) == MAX_CUT_SIZE, "cut benchmark has to end at MAX_CUT_SIZE");
+
+// same as tree_is_leaf, tree_node_index and tree_children in shaders/lightcuts.inc for the lbvh 
+// (id = array index) and the complete layout (id in breadth first order, root = 0)
+static inline bool cut_is_leaf(const std::vector<node_t>& nodes, u32 id)
+{
+    u32 num_leaf_nodes = static_cast<u32>(nodes.size() + 1) / 2;
+    return id >= static_cast<u32>(nodes.size()) - num_leaf_nodes;
+}
+
+static inline const node_t& cut_node(const std::vector<node_t>& nodes, u32 tree_type, u32 id)
+{
+    return tree_type == LIGHT_TREE_TYPE_LBVH ? nodes[id] : nodes[get_array_index(id, static_cast<u32>(nodes.size()))];
+}
+
+static inline void cut_children(const std::vector<node_t>& nodes, u32 tree_type, u32 id, u32& c0, u32& c1)
+{
+    if (tree_type == LIGHT_TREE_TYPE_LBVH)
+    {
+        u32 node_id = nodes[id].id;
+        u32 split = node_id & LBVH_SPLIT_MASK;
+        u32 first_leaf = static_cast<u32>(nodes.size() + 1) / 2 - 1;
+        c0 = (node_id & LBVH_LEFT_LEAF_BIT)  != 0 ? first_leaf + split     : split;
+        c1 = (node_id & LBVH_RIGHT_LEAF_BIT) != 0 ? first_leaf + split + 1 : split + 1;
+    }
+    else
+    {
+        c0 = 2 * id + 1;
+        c1 = c0 + 1;
+    }
+}
+
+// same as calc_node_error in shaders/lightcuts.inc
+static f32 cut_error(const node_t& node, v3 p, v3 normal)
+{
+    f32 dmin2 = MAX(squared_min_distance(p, node.bbox_min, node.bbox_max), 1e-8f);
+    return geometric_term(p, normal, node.bbox_min, node.bbox_max) * oriented_intensity(node, p) / dmin2;
+}
+
+static inline u32 cut_size(const std::vector<node_t>& nodes, u32 max_size)
+{
+    u32 num_lights = static_cast<u32>(nodes.size() + 1) / 2;
+    return clamp(MIN(max_size, num_lights), 1u, static_cast<u32>(MAX_CUT_SIZE));
+}
+
+// the cut of gen_light_cut before the heap, used to compare the cost and to check the heap
+static u32 gen_light_cut_linear(const std::vector<node_t>& nodes, u32 tree_type, v3 p, v3 normal, u32 max_size, u32 cut[MAX_CUT_SIZE])
+{
+    u32 size = cut_size(nodes, max_size);
+    f32 errors[MAX_CUT_SIZE];
+    u32 selected = 1;
+    cut[0] = 0;
+    errors[0] = FLT_MAX;
+    while (selected < size)
+    {
+        i32 max_i = -1;
+        for (u32 i = 0; i < selected; i++)
+        {
+            if (!cut_is_leaf(nodes, cut[i]) && (max_i < 0 || errors[i] > errors[max_i]))
+            {
+                max_i = static_cast<i32>(i);
+            }
+        }
+        if (max_i < 0)
+        {
+            break; // only leaf nodes
+        }
+        u32 c0, c1;
+        cut_children(nodes, tree_type, cut[max_i], c0, c1);
+        cut[max_i] = c0;
+        errors[max_i] = cut_error(cut_node(nodes, tree_type, c0), p, normal);
+        const node_t& n1 = cut_node(nodes, tree_type, c1);
+        if (n1.intensity > 0)
+        {
+            cut[selected] = c1;
+            errors[selected] = cut_error(n1, p, normal);
+            selected++;
+        }
+    }
+    return selected;
+}
+
+u32 gen_light_cut(const std::vector<node_t>& nodes, u32 tree_type, v3 p, v3 normal, u32 max_size, u32 cut[MAX_CUT_SIZE])
+{
+    struct cut_node_t
+    {
+        u32 id;
+        f32 error;
+    };
+
+    // heap of the inner nodes at [0, heap_size), leaf nodes from the back at [size - num_leafs, size)
+    u32 size = cut_size(nodes, max_size);
+    cut_node_t light_cut[MAX_CUT_SIZE];
+    u32 heap_size = 0;
+    u32 num_leafs = 0;
+    auto add_node = [&](u32 id, f32 error)
+    {
+        if (cut_is_leaf(nodes, id))
+        {
+            num_leafs++;
+            light_cut[size - num_leafs] = { id, error };
+            return;
+        }
+        u32 i = heap_size++;
+        while (i > 0 && light_cut[(i - 1) / 2].error < error)
+        {
+            light_cut[i] = light_cut[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        light_cut[i] = { id, error };
+    };
+    auto pop_node = [&]()
+    {
+        cut_node_t last = light_cut[--heap_size];
+        u32 i = 0;
+        while (2 * i + 1 < heap_size)
+        {
+            u32 child = 2 * i + 1;
+            if (child + 1 < heap_size && light_cut[child + 1].error > light_cut[child].error)
+            {
+                child++;
+            }
+            if (last.error >= light_cut[child].error)
+            {
+                break;
+            }
+            light_cut[i] = light_cut[child];
+            i = child;
+        }
+        light_cut[i] = last;
+    };
+
+    add_node(0, FLT_MAX);
+    while (heap_size > 0 && heap_size + num_leafs < size)
+    {
+        u32 id = light_cut[0].id;
+        pop_node();
+        u32 c0, c1;
+        cut_children(nodes, tree_type, id, c0, c1);
+        add_node(c0, cut_error(cut_node(nodes, tree_type, c0), p, normal));
+        const node_t& n1 = cut_node(nodes, tree_type, c1);
+        if (n1.intensity > 0)
+        {
+            add_node(c1, cut_error(n1, p, normal));
+        }
+    }
+    for (u32 i = 0; i < heap_size; i++)
+    {
+        cut[i] = light_cut[i].id;
+    }
+    for (u32 i = 0; i < num_leafs; i++)
+    {
+        cut[heap_size + i] = light_cut[size - num_leafs + i].id;
+    }
+    return heap_size + num_leafs;
+}
+
+// variance of the estimator of the unshadowed diffuse light at p divided by its squared mean (averaged over the 
+// color channels, the tree only knows the summed intensity so mixed colors add noise per channel). the cut of 
+// gen_light_cut with cut_size nodes selects one light below every node of the cut (as in select_lights), the 
+// probability of every light is found by walking the subtree of its cut node (lights the traversal cannot reach 
+// are skipped) and the variance is the sum of the variance of the selection in every subtree
+static f64 relative_variance(const std::vector<light_t>& lights, const std::vector<node_t>& nodes, v3 p, v3 normal, u32 cut_size)
+{
+    u32 n = static_cast<u32>(lights.size());
+    u32 cut[MAX_CUT_SIZE];
+    u32 size = gen_light_cut(nodes, LIGHT_TREE_TYPE_LBVH, p, normal, cut_size, cut);
+    f64 mean[3] = {};
+    f64 variance[3] = {};
+
+    struct entry_t
+    {
+        u32 index;
+        f64 prob;
+    };
+    std::vector<entry_t> stack;
+    for (u32 i = 0; i < size; i++)
+    {
+        f64 node_mean[3] = {};
+        f64 node_second_moment[3] = {};
+        stack.push_back({ cut[i], 1.0 });
+        while (!stack.empty())
+        {
+            entry_t e = stack.back();
+            stack.pop_back();
+            const node_t& node = nodes[e.index];
+            if (e.index >= n - 1)
+            {
+                if (node.intensity <= 0) continue;
+                const light_t& light = lights[node.id];
+                v3 l = light.pos.xyz - p;
+                f32 d2 = dot(l, l);
+                f32 falloff = spot_falloff(light.direction, light.cone_angle, l / sqrtf(d2));
+                f64 g = falloff * MAX(dot(normal, l), 0.0f) / (sqrtf(d2) * d2);
+                for (u32 k = 0; k < 3; k++)
+                {
+                    f64 f = light.color.data[k] * g;
+                    node_mean[k] += f;
+                    node_second_moment[k] += f * f / e.prob;
+                }
+                continue;
+            }
+
+            u32 split = node.id & LBVH_SPLIT_MASK;
+            u32 c0 = (node.id & LBVH_LEFT_LEAF_BIT)  != 0 ? n - 1 + split : split;
+            u32 c1 = (node.id & LBVH_RIGHT_LEAF_BIT) != 0 ? n + split     : split + 1;
+            f32 prob_c0 = child_probability(p, normal, nodes[c0], nodes[c1]);
+            if (prob_c0 > 0.0f) stack.push_back({ c0, e.prob * prob_c0 });
+            if (prob_c0 >= 0.0f && prob_c0 < 1.0f) stack.push_back({ c1, e.prob * (1.0f - prob_c0) });
+        }
+        for (u32 k = 0; k < 3; k++)
+        {
+            mean[k] += node_mean[k];
+            variance[k] += node_second_moment[k] - node_mean[k] * node_mean[k];
+        }
+    }
+    f64 relative = 0.0;
+    u32 channels = 0;
+    for (u32 k = 0; k < 3; k++)
+    {
+        if (mean[k] > 0.0)
+        {
+            relative += variance[k] / (mean[k] * mean[k]);
+            channels++;
+        }
+    }
+    return channels > 0 ? relative / channels : 0.0;
+}
+
+void benchmark_light_trees(const std::vector<light_t>& lights, u32 num_points, u32 num_samples, u32 cut_size, light_tree_benchmark_t& result)
+{
+    result = light_tree_benchmark_t();
+    result.num_lights = static_cast<u32>(lights.size());
+    result.cut_size = cut_size;
+    if (lights.size() < 2)
+    {
+        return;
+    }
+
+    using clock = std::chrono::steady_clock;
+    std::vector<node_t> saoh;
+    std::vector<node_t> morton;
+    std::vector<node_t> morton_color;
+    std::vector<node_t> morton_orientation;
+    auto t0 = clock::now();
+    build_light_tree_saoh(lights, saoh);
+    auto t1 = clock::now();
+    build_light_tree_morton(lights, morton, MORTON_KEY_POSITION);
+    auto t2 = clock::now();
+    build_light_tree_morton(lights, morton_color, MORTON_KEY_COLOR);
+    auto t3 = clock::now();
+    build_light_tree_morton(lights, morton_orientation, MORTON_KEY_ORIENTATION);
+    auto t4 = clock::now();
+    result.saoh_build_ms = std::chrono::duration<f64, std::milli>(t1 - t0).count();
+    result.morton_build_ms = std::chrono::duration<f64, std::milli>(t2 - t1).count();
+    result.morton_color_build_ms = std::chrono::duration<f64, std::milli>(t3 - t2).count();
+    result.morton_orientation_build_ms = std::chrono::duration<f64, std::milli>(t4 - t3).count();
+
+    // same random points around the lights for both trees
+    const node_t& root = saoh[0];
+    v3 center = (root.bbox_min + root.bbox_max) * 0.5f;
+    v3 extent = root.bbox_max - root.bbox_min;
+    f64 saoh_variance = 0.0;
+    f64 morton_variance = 0.0;
+    f64 morton_color_variance = 0.0;
+    f64 morton_orientation_variance = 0.0;
+    for (u32 i = 0; i < num_points; i++)
+    {
+        v3 p = center + mul(extent, vec3(_randf() - 0.5f, _randf() - 0.5f, _randf() - 0.5f)) * 2.0f;
+        v3 normal = normalize(vec3(_randf2(), _randf2(), _randf2()) + vec3(1e-4f));
+        saoh_variance += relative_variance(lights, saoh, p, normal, cut_size);
+        morton_variance += relative_variance(lights, morton, p, normal, cut_size);
+        morton_color_variance += relative_variance(lights, morton_color, p, normal, cut_size);
+        morton_orientation_variance += relative_variance(lights, morton_orientation, p, normal, cut_size);
+    }
+    // the samples are independent, their average has 1 / num_samples of the variance
+    f64 scale = 1.0 / (static_cast<f64>(num_points) * num_samples);
+    result.num_samples = num_samples;
+    result.saoh_variance = static_cast<f32>(saoh_variance * scale);
+    result.morton_variance = static_cast<f32>(morton_variance * scale);
+    result.morton_color_variance = static_cast<f32>(morton_color_variance * scale);
+    result.morton_orientation_variance = static_cast<f32>(morton_orientation_variance * scale);
+
+    // cut cost per point for growing cut sizes
+    std::vector<v3> points(num_points);
+    std::vector<v3> normals(num_points);
+    for (u32 i = 0; i < num_points; i++)
+    {
+        points[i] = center + mul(extent, vec3(_randf() - 0.5f, _randf() - 0.5f, _randf() - 0.5f)) * 2.0f;
+        normals[i] = normalize(vec3(_randf2(), _randf2(), _randf2()) + vec3(1e-4f));
+    }
+    f64 num_cuts = static_cast<f64>(num_points) * CUT_BENCHMARK_REPEAT;
+    for (u32 k = 0; k < CUT_BENCHMARK_SIZES; k++)
+    {
+        u32 size = 1u << k;
+        u32 linear_cut[MAX_CUT_SIZE];
+        u32 heap_cut[MAX_CUT_SIZE];
+        u64 linear_nodes = 0;
+        u64 heap_nodes = 0;
+        auto c0 = clock::now();
+        for (u32 r = 0; r < CUT_BENCHMARK_REPEAT; r++)
+        {
+            for (u32 i = 0; i < num_points; i++)
+            {
+                linear_nodes += gen_light_cut_linear(saoh, LIGHT_TREE_TYPE_LBVH, points[i], normals[i], size, linear_cut);
+            }
+        }
+        auto c1 = clock::now();
+        for (u32 r = 0; r < CUT_BENCHMARK_REPEAT; r++)
+        {
+            for (u32 i = 0; i < num_points; i++)
+            {
+                heap_nodes += gen_light_cut(saoh, LIGHT_TREE_TYPE_LBVH, points[i], normals[i], size, heap_cut);
+            }
+        }
+        auto c2 = clock::now();
+
+        // both have to split the same nodes (the order in the cut differs)
+        for (u32 i = 0; i < num_points; i++)
+        {
+            u32 n0 = gen_light_cut_linear(saoh, LIGHT_TREE_TYPE_LBVH, points[i], normals[i], size, linear_cut);
+            u32 n1 = gen_light_cut(saoh, LIGHT_TREE_TYPE_LBVH, points[i], normals[i], size, heap_cut);
+            std::sort(linear_cut, linear_cut + n0);
+            std::sort(heap_cut, heap_cut + n1);
+            if (n0 != n1 || !std::equal(linear_cut, linear_cut + n0, heap_cut))
+            {
+                result.cut_mismatches++;
+            }
+        }
+        result.cut_sizes[k] = size;
+        result.linear_cut_ns[k] = std::chrono::duration<f64, std::nano>(c1 - c0).count() / num_cuts;
+        result.heap_cut_ns[k] = std::chrono::duration<f64, std::nano>(c2 - c1).count() / num_cuts;
+        result.average_cut_size[k] = static_cast<f32>((linear_nodes + heap_nodes) / (2.0 * num_cuts)); // same unless mismatches
+    }
+}
+
+bool check_quantized_bounds(const std::vector<light_t>& lights)
+{
+    std::vector<node_t> nodes;
+    std::vector<quant_node_t> quant_nodes;
+    build_light_tree_complete(lights, nodes);
+    build_quant_tree(nodes, quant_nodes);
+
+    // walk from the root to every leaf node and decode the bounds like quant_node_bounds in shaders/lightcuts.inc
+    u32 num_nodes = static_cast<u32>(nodes.size());
+    u32 num_leaf_nodes = (num_nodes + 1) / 2;
+    u32 height = get_msb(num_leaf_nodes);
+    for (u32 i = 0; i < num_leaf_nodes; i++)
+    {
+        u32 id = num_leaf_nodes - 1 + i;
+        const quant_node_t& leaf = quant_nodes[get_array_index(id, num_nodes)];
+        if (leaf.intensity <= 0)
+        {
+            continue; // dummy node or a light without intensity (never selected)
+        }
+        if (leaf.id >= lights.size())
+        {
+            LOG_ERROR("Quantized tree: leaf node %u has invalid light id %u", id, leaf.id);
+            return false;
+        }
+
+        v3 p = lights[leaf.id].pos.xyz;
+        v3 bbox_min = nodes[num_nodes - 1].bbox_min;
+        v3 bbox_max = nodes[num_nodes - 1].bbox_max;
+        for (u32 l = 0; l <= height; l++)
+        {
+            u32 ancestor = ((id + 1) >> (height - l)) - 1;
+            if (l > 0)
+            {
+                decode_quant_bounds(quant_nodes[get_array_index(ancestor, num_nodes)], bbox_min, bbox_max, bbox_min, bbox_max);
+            }
+            for (u32 k = 0; k < 3; k++)
+            {
+                if (p.data[k] < bbox_min.data[k] || p.data[k] > bbox_max.data[k])
+                {
+                    LOG_ERROR("Quantized tree: light %u (%f, %f, %f) is outside of the decoded bounds of node %u (level %u)", 
+                            leaf.id, p.x, p.y, p.z, ancestor, l);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// lights at random positions in [offset - extent, offset + extent], every zero_every'th light has no intensity
+static void random_check_lights(std::vector<light_t>& lights, u32 count, v3 offset, f32 extent, u32 zero_every)
+{
+    lights.resize(count);
+    for (u32 i = 0; i < count; i++)
+    {
+        light_t& light = lights[i];
+        light.pos = vec4(offset + vec3(_randf2(), _randf2(), _randf2()) * extent, 1);
+        light.color = vec4(vec3(_randf(), _randf(), _randf()) + vec3(0.01f), 0);
+        if (zero_every > 0 && i % zero_every == 0)
+        {
+            light.color = vec4(0);
+        }
+        light.direction = normalize(vec3(_randf2(), _randf2(), _randf2()) + vec3(1e-4f));
+        light.cone_angle = i % 2 ? LIGHT_CONE_OMNI : _randf() * PI;
+    }
+}
+
+// cut of one point of check_light_cuts
+static bool check_light_cut(const std::vector<node_t>& nodes, u32 tree_type, const std::vector<light_t>& lights, 
+        const u32* cut, u32 n, u32 max_size, std::vector<u32>& counts)
+{
+    const char* type_name = tree_type == LIGHT_TREE_TYPE_LBVH ? "lbvh" : "complete";
+    if (n == 0 || n > max_size || n > MAX_CUT_SIZE)
+    {
+        LOG_ERROR("Light cut (%s): %u nodes for max size %u", type_name, n, max_size);
+        return false;
+    }
+
+    // every light with intensity is below exactly one node of the cut
+    std::fill(counts.begin(), counts.end(), 0);
+    std::vector<u32> stack;
+    bool only_leafs = true;
+    for (u32 i = 0; i < n; i++)
+    {
+        only_leafs &= cut_is_leaf(nodes, cut[i]);
+        stack.push_back(cut[i]);
+        while (!stack.empty())
+        {
+            u32 id = stack.back();
+            stack.pop_back();
+            const node_t& node = cut_node(nodes, tree_type, id);
+            if (node.intensity <= 0)
+            {
+                continue;
+            }
+            if (cut_is_leaf(nodes, id))
+            {
+                if (node.id >= lights.size())
+                {
+                    LOG_ERROR("Light cut (%s): leaf node %u has invalid light id %u", type_name, id, node.id);
+                    return false;
+                }
+                counts[node.id]++;
+                continue;
+            }
+            u32 c0, c1;
+            cut_children(nodes, tree_type, id, c0, c1);
+            stack.push_back(c0);
+            stack.push_back(c1);
+        }
+    }
+    for (u32 i = 0; i < lights.size(); i++)
+    {
+        f32 intensity = lights[i].color.x + lights[i].color.y + lights[i].color.z;
+        if (intensity > 0 && counts[i] != 1)
+        {
+            LOG_ERROR("Light cut (%s): light %u is below %u nodes of the cut (size %u)", type_name, i, counts[i], n);
+            return false;
+        }
+    }
+
+    // a smaller cut than asked for only has leaf nodes left
+    if (n < cut_size(nodes, max_size) && !only_leafs)
+    {
+        LOG_ERROR("Light cut (%s): %u nodes for max size %u with inner nodes left", type_name, n, max_size);
+        return false;
+    }
+    return true;
+}
+
+// true if two inner nodes with lights have the same error at p (the heap and the linear scan can split different ones).
+// a node with an empty second child is a copy of its first child (dummy nodes of the complete tree) and is skipped, 
+// both are never in the cut at the same time
+static bool has_error_ties(const std::vector<node_t>& nodes, u32 tree_type, v3 p, v3 normal)
+{
+    std::vector<f32> errors;
+    u32 num_inner_nodes = static_cast<u32>(nodes.size() - 1) / 2;
+    for (u32 id = 0; id < num_inner_nodes; id++)
+    {
+        u32 c0, c1;
+        cut_children(nodes, tree_type, id, c0, c1);
+        const node_t& node = cut_node(nodes, tree_type, id);
+        if (node.intensity > 0 && cut_node(nodes, tree_type, c1).intensity > 0)
+        {
+            errors.push_back(cut_error(node, p, normal));
+        }
+    }
+    std::sort(errors.begin(), errors.end());
+    return std::adjacent_find(errors.begin(), errors.end()) != errors.end();
+}
+
+static bool check_light_cuts(const std::vector<node_t>& nodes, u32 tree_type, const std::vector<light_t>& lights, 
+        const std::vector<v3>& points, const std::vector<v3>& normals, bool compare_linear)
+{
+    const char* type_name = tree_type == LIGHT_TREE_TYPE_LBVH ? "lbvh" : "complete";
+    std::vector<u32> counts(lights.size());
+    u32 compared = 0;
+    for (u32 i = 0; i < points.size(); i++)
+    {
+        bool ties = compare_linear && has_error_ties(nodes, tree_type, points[i], normals[i]);
+        compared += compare_linear && !ties ? 1 : 0;
+        for (u32 max_size = 1; max_size <= MAX_CUT_SIZE + 1; max_size++)
+        {
+            u32 heap_cut[MAX_CUT_SIZE];
+            u32 n = gen_light_cut(nodes, tree_type, points[i], normals[i], max_size, heap_cut);
+            if (!check_light_cut(nodes, tree_type, lights, heap_cut, n, max_size, counts))
+            {
+                return false;
+            }
+            if (!compare_linear || ties)
+            {
+                continue;
+            }
+
+            // without ties both split the same nodes (the order in the cut differs)
+            u32 linear_cut[MAX_CUT_SIZE];
+            u32 n_linear = gen_light_cut_linear(nodes, tree_type, points[i], normals[i], max_size, linear_cut);
+            std::sort(heap_cut, heap_cut + n);
+            std::sort(linear_cut, linear_cut + n_linear);
+            if (n != n_linear || !std::equal(heap_cut, heap_cut + n, linear_cut))
+            {
+                LOG_ERROR("Light cut (%s): heap and linear cut differ at point %u with max size %u (%u and %u nodes)", 
+                        type_name, i, max_size, n, n_linear);
+                return false;
+            }
+        }
+    }
+    if (compare_linear && compared * 2 < points.size())
+    {
+        LOG_ERROR("Light cut (%s): only %u of %u points without ties", type_name, compared, static_cast<u32>(points.size()));
+        return false;
+    }
+    return true;
+}
+
+bool check_light_cuts(const std::vector<light_t>& lights, const std::vector<v3>& points, const std::vector<v3>& normals, 
+        bool compare_linear)
+{
+    std::vector<node_t> saoh;
+    std::vector<node_t> morton;
+    std::vector<node_t> complete;
+    build_light_tree_saoh(lights, saoh);
+    build_light_tree_morton(lights, morton, MORTON_KEY_POSITION);
+    build_light_tree_complete(lights, complete);
+    return check_light_cuts(saoh, LIGHT_TREE_TYPE_LBVH, lights, points, normals, compare_linear)
+        && check_light_cuts(morton, LIGHT_TREE_TYPE_LBVH, lights, points, normals, compare_linear)
+        && check_light_cuts(complete, LIGHT_TREE_TYPE_COMPLETE, lights, points, normals, compare_linear);
+}
+
+bool check_light_trees()
+{
+    srand(1);
+    bool ok = true;
+    std::vector<light_t> lights;
+
+    // around the origin, far from it in a small volume (rounding of the dequantized bounds), 
+    // lights on the same position and a flat set (zero extent on one axis)
+    const u32 counts[4] = { 2, 97, 1024, 5000 };
+    for (u32 count : counts)
+    {
+        random_check_lights(lights, count, vec3(0), 5.0f, 7);
+        ok &= check_quantized_bounds(lights);
+        random_check_lights(lights, count, vec3(1000.0f, -250.0f, 3.0f), 0.01f, 0);
+        ok &= check_quantized_bounds(lights);
+        for (auto& light : lights)
+        {
+            light.pos = lights[0].pos;
+        }
+        ok &= check_quantized_bounds(lights);
+        random_check_lights(lights, count, vec3(0), 3.0f, 0);
+        for (auto& light : lights)
+        {
+            light.pos.y = 1.5f;
+        }
+        ok &= check_quantized_bounds(lights);
+    }
+
+    // cuts at random points around the lights (spot lights, lights without intensity) and cuts without 
+    // ties in the errors: point lights above the points, the normals face the lights
+    const u32 cut_counts[4] = { 1, 5, 64, 700 };
+    const u32 num_points = 16;
+    std::vector<v3> points(num_points);
+    std::vector<v3> normals(num_points);
+    for (u32 count : cut_counts)
+    {
+        random_check_lights(lights, count, vec3(0), 5.0f, 5);
+        for (u32 i = 0; i < num_points; i++)
+        {
+            points[i] = vec3(_randf2(), _randf2(), _randf2()) * 8.0f;
+            normals[i] = normalize(vec3(_randf2(), _randf2(), _randf2()) + vec3(1e-4f));
+        }
+        ok &= check_light_cuts(lights, points, normals, false);
+
+        random_check_lights(lights, count, vec3(0, 3, 0), 2.0f, 0);
+        for (auto& light : lights)
+        {
+            light.cone_angle = LIGHT_CONE_OMNI;
+        }
+        for (u32 i = 0; i < num_points; i++)
+        {
+            points[i] = vec3(_randf2() * 4.0f, -_randf(), _randf2() * 4.0f);
+            normals[i] = vec3(0, 1, 0);
+        }
+        ok &= check_light_cuts(lights, points, normals, true);
+    }
+    LOG_INFO("Light tree checks %s", ok ? "passed" : "failed");
+    return ok;
+}
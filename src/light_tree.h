@@ -0,0 +1,83 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include "common.h"
+#include "shader_data.h"
+
+#include <vector>
+
+// decodes the quantized tree (LIGHT_TREE_TYPE_QUANTIZED) like the traversal does and returns the number 
+// of lights that are outside of the decoded bounds of their leaf node (0 = bounds are conservative)
+// root = root of the full precision tree, quant_nodes = complete tree of num_nodes nodes read back from the gpu
+u32 count_unbounded_lights(const node_t& root, const quant_node_t* quant_nodes, u32 num_nodes, const std::vector<light_t>& lights);
+
+// builds a tree in the lbvh layout (LIGHT_TREE_TYPE_LBVH) top down on multiple threads, the lights are split
+// with a binned surface area orientation heuristic (energy * surface area of the children), 
+// leaf node id = index into lights. used for the static lights of the two-level tree
+void build_light_tree_saoh(const std::vector<light_t>& lights, std::vector<node_t>& nodes);
+
+// the static tree is cached on disk, bump the version when the builder or the layout of the file changes
+#define LIGHT_TREE_CACHE_PATH "light_tree.cache"
+#define LIGHT_TREE_CACHE_VERSION 2
+
+u64 hash_lights(const std::vector<light_t>& lights);
+
+// maps the cache file and copies its nodes if it was written for the same lights (hash, count), same 
+// node layout and the same cache version. returns false if the tree has to be rebuilt
+bool load_light_tree_cache(const char* path, u64 lights_hash, u32 num_lights, std::vector<node_t>& nodes);
+bool save_light_tree_cache(const char* path, u64 lights_hash, u32 num_lights, const std::vector<node_t>& nodes);
+
+// same as gen_light_cut in shaders/lightcuts.inc for a tree in the lbvh or the complete layout (tree_type = 
+// LIGHT_TREE_TYPE_LBVH or LIGHT_TREE_TYPE_COMPLETE): splits the node with the highest error (max-heap) until the 
+// cut has max_size nodes or only leaf nodes. cut = node ids like the shader uses them, returns the cut size
+u32 gen_light_cut(const std::vector<node_t>& nodes, u32 tree_type, v3 p, v3 normal, u32 max_size, u32 cut[MAX_CUT_SIZE]);
+
+#define CUT_BENCHMARK_SIZES 7 // 1 .. MAX_CUT_SIZE
+#define CUT_BENCHMARK_REPEAT 16
+
+struct light_tree_benchmark_t
+{
+    u32 num_lights = 0;
+    u32 num_samples = 0;
+    u32 cut_size = 0;
+    f64 saoh_build_ms = 0.0;
+    f64 morton_build_ms = 0.0;
+    f64 morton_color_build_ms = 0.0;       // MORTON_KEY_COLOR
+    f64 morton_orientation_build_ms = 0.0; // MORTON_KEY_ORIENTATION
+    f32 saoh_variance = 0.0f;   // average relative variance of the estimate with num_samples cuts of cut_size nodes
+    f32 morton_variance = 0.0f;
+    f32 morton_color_variance = 0.0f;
+    f32 morton_orientation_variance = 0.0f;
+
+    // cost of building the cut of one point with a linear scan for the node with the highest error (O(k^2))
+    // and with the heap of gen_light_cut (O(k log k)) for cut sizes 1, 2, 4, .., MAX_CUT_SIZE
+    u32 cut_sizes[CUT_BENCHMARK_SIZES] = {};
+    f64 linear_cut_ns[CUT_BENCHMARK_SIZES] = {};
+    f64 heap_cut_ns[CUT_BENCHMARK_SIZES] = {};
+    f32 average_cut_size[CUT_BENCHMARK_SIZES] = {}; // smaller than the cut size if only leaf nodes are left
+    u32 cut_mismatches = 0; // points where both builds found different cuts (nodes with the same error)
+};
+
+// compares the saoh tree with the trees of the gpu build (morton order with every MORTON_KEY_*, complete tree 
+// splits) built on the cpu. noise = variance of the unshadowed diffuse light estimated with num_samples samples 
+// of one light per node of the cut of gen_light_cut with cut_size nodes (same cut and traversal probabilities as 
+// lightcuts.inc) at num_points random points around the lights. the cuts are timed on the saoh tree at the same 
+// number of points
+void benchmark_light_trees(const std::vector<light_t>& lights, u32 num_points, u32 num_samples, u32 cut_size, light_tree_benchmark_t& result);
+
+// cpu checks of the trees the gpu builds, they log the first error and return false if the check failed.
+// the quantized tree is encoded and decoded like shaders/light_tree_quant.comp and shaders/lightcuts.inc, 
+// every light has to be inside of the decoded bounds of its leaf node and of all of its ancestors
+bool check_quantized_bounds(const std::vector<light_t>& lights);
+
+// builds the cuts of every point for every max size up to MAX_CUT_SIZE + 1 with gen_light_cut on the saoh, the lbvh 
+// and the complete tree of the lights. a cut has to have at most max size nodes (fewer only if they are all leaf 
+// nodes) and every light with intensity has to be below exactly one of them. compare_linear = the lights and points 
+// have no ties in the errors, the cut of the heap then has to be the same as the cut of the linear scan
+bool check_light_cuts(const std::vector<light_t>& lights, const std::vector<v3>& points, const std::vector<v3>& normals, 
+        bool compare_linear);
+
+// runs the checks on sets of random lights (engine --check, also run by ctest)
+bool check_light_trees();
+
+#endif // LIGHT_TREE_H
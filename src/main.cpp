@@ -8,6 +8,8 @@
 #include "ui.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 
 #define WIDTH 1280
 #define HEIGHT 960
@@ -15,6 +17,7 @@
 #define USE_RANDOM_LIGHTS 0
 #define DISTANCE_FROM_ORIGIN 1
 #define RANDOM_LIGHT_COUNT 1<<10//(1 << 17) // 17 is around 100000 lights (sorting worse after this)
+#define TREE_BENCHMARK_POINTS 256
 
 static v3 random_color()
 {
@@ -30,33 +33,80 @@ static v3 random_color()
     return vec3(0,0,1);
 }
 
-static void add_random_lights(scene_t& scene, u32 count, v3 origin, f32 distance)
+// cone_angle in degrees, 180 = point lights
+static void add_random_lights(scene_t& scene, u32 count, v3 origin, f32 distance, f32 cone_angle, bool is_static = false)
 {
+    f32 angle = cone_angle < 180.0f ? radians(cone_angle) : LIGHT_CONE_OMNI;
     for (u32 i = 0; i < count; ++i)
     {
         v3 color = random_color();//vec3(_randf(), _randf(), _randf());
         v3 dir = normalize(vec3(_randf2(), _randf(), _randf2()));
         v3 pos = origin + dir * distance;
-        add_light(scene, pos, color);
+        v3 direction = normalize(vec3(_randf2(), _randf2(), _randf2()) + vec3(1e-4f));
+        if (is_static)
+        {
+            add_static_light(scene, pos, color, direction, angle);
+        }
+        else
+        {
+            add_light(scene, pos, color, direction, angle);
+        }
     }
 }
 
+static void add_gpu_lights(scene_t& scene, u32 count, f32 distance, f32 cone_angle)
+{
+    scene.gpu_lights.count = count;
+    scene.gpu_lights.seed = static_cast<u32>(rand());
+    scene.gpu_lights.distance = distance;
+    scene.gpu_lights.cone_angle = cone_angle < 180.0f ? radians(cone_angle) : LIGHT_CONE_OMNI;
+    scene.gpu_lights.offset = vec3(0);
+    update_lights_version(scene);
+}
+
 static void move_lights_from_origin(scene_t& scene, v3 origin, f32 distance)
 {
+    scene.gpu_lights.distance = distance;
     v4 orig  = vec4(origin, 0);
     for (auto& light : scene.lights)
     {
         v4 dir = normalize(light.pos - vec4(origin, 1));
         light.pos = orig + dir * distance;
     }
+    update_lights_version(scene);
 }
 
 static void move_lights(scene_t& scene, v4 t)
 {
+    scene.gpu_lights.offset += t.xyz;
     for (auto& light : scene.lights) 
     {
         light.pos += t;
     }
+    update_lights_version(scene);
+}
+
+// the static lights are the same on every launch, the tree of the last run is cached on disk
+static void build_static_light_tree(scene_t& scene, render_state_t& state)
+{
+    scene.static_tree.clear();
+    state.static_tree_cached = false;
+    state.static_tree_build_ms = 0.0;
+    if (scene.static_lights.empty())
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    u32 num_static_lights = static_cast<u32>(scene.static_lights.size());
+    u64 lights_hash = hash_lights(scene.static_lights);
+    state.static_tree_cached = load_light_tree_cache(LIGHT_TREE_CACHE_PATH, lights_hash, num_static_lights, scene.static_tree);
+    if (!state.static_tree_cached)
+    {
+        build_light_tree_saoh(scene.static_lights, scene.static_tree);
+        save_light_tree_cache(LIGHT_TREE_CACHE_PATH, lights_hash, num_static_lights, scene.static_tree);
+    }
+    state.static_tree_build_ms = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
 static void add_default_lights(scene_t& scene) 
@@ -67,8 +117,17 @@ static void add_default_lights(scene_t& scene)
     add_light(scene, vec3(-2, 3, 2), vec3(1, 1, 1));
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    // cpu checks of the light trees, no window or device needed
+    for (i32 i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--check") == 0)
+        {
+            return check_light_trees() ? 0 : 1;
+        }
+    }
+
     window_t window;
     window.create_window("Engine", WIDTH, HEIGHT);
     renderer_t renderer(&window); 
@@ -102,7 +161,7 @@ int main()
 #if !USE_RANDOM_LIGHTS
         add_default_lights(scene);
 #else
-        add_random_lights(scene, RANDOM_LIGHT_COUNT, vec3(0), DISTANCE_FROM_ORIGIN);
+        add_random_lights(scene, RANDOM_LIGHT_COUNT, vec3(0), DISTANCE_FROM_ORIGIN, 180.0f);
 #endif
         std::sort(std::begin(scene.entities), std::end(scene.entities),
                 [](const entity_t& a, const entity_t& b) 
@@ -134,7 +193,8 @@ int main()
     bool pause = false;
 
     render_state_t render_state;
-    render_state.cut = (cut_t*) malloc(sizeof(cut_t) * MAX_LIGHT_TREE_SIZE);
+    bool static_lights_pending = false; // the number of static lights or the cone angle changed
+    render_state.cut = (cut_t*) malloc(sizeof(cut_t) * MAX_DEBUG_TREE_SIZE);
     camera_t *curr_camera = &camera;
     while(run)
     {
@@ -144,18 +204,61 @@ int main()
 
         render_state_t prev = render_state;
         bool imgui_mouse = new_frame(renderer.imgui, &render_state, &scene, time);
-        if (prev.use_random_lights != render_state.use_random_lights || render_state.num_random_lights != prev.num_random_lights)
+        bool spot_changed = render_state.spot_cone_angle != prev.spot_cone_angle;
+        if (prev.use_random_lights != render_state.use_random_lights || render_state.num_random_lights != prev.num_random_lights
+                || (spot_changed && render_state.use_random_lights) || prev.gpu_lights != render_state.gpu_lights)
         {
             scene.lights.clear();
-            if (render_state.use_random_lights)
+            scene.gpu_lights.count = 0;
+            update_lights_version(scene);
+            if (render_state.use_random_lights && render_state.gpu_lights)
+            {
+                add_gpu_lights(scene, render_state.num_random_lights, render_state.distance_from_origin, 
+                        render_state.spot_cone_angle);
+            }
+            else if (render_state.use_random_lights)
             {
-                add_random_lights(scene, render_state.num_random_lights, vec3(0), render_state.distance_from_origin);
+                add_random_lights(scene, render_state.num_random_lights, vec3(0), render_state.distance_from_origin, 
+                        render_state.spot_cone_angle);
             }
             else
             {
                 add_default_lights(scene);
             }
         }
+        // noise and build time of the saoh tree compared to the morton trees (same splits as the gpu build)
+        if (render_state.run_tree_benchmark)
+        {
+            render_state.run_tree_benchmark = false;
+            // the gpu lights are not on the cpu, only the static lights can be used
+            const auto& lights = scene.static_lights.empty() ? scene.lights : scene.static_lights;
+            benchmark_light_trees(lights, TREE_BENCHMARK_POINTS, render_state.num_samples, static_cast<u32>(render_state.cut_size), render_state.tree_benchmark);
+            const auto& b = render_state.tree_benchmark;
+            LOG_INFO("Tree benchmark (%u lights, %u samples, cut size %u): saoh %.3f ms variance %.4f, morton %.3f ms variance %.4f, "
+                    "morton color %.3f ms variance %.4f, morton orientation %.3f ms variance %.4f", 
+                    b.num_lights, b.num_samples, b.cut_size, b.saoh_build_ms, b.saoh_variance, b.morton_build_ms, b.morton_variance,
+                    b.morton_color_build_ms, b.morton_color_variance, b.morton_orientation_build_ms, b.morton_orientation_variance);
+            for (u32 k = 0; k < CUT_BENCHMARK_SIZES; k++)
+            {
+                LOG_INFO("Cut size %u (average %.1f nodes): linear %.0f ns, heap %.0f ns", b.cut_sizes[k], b.average_cut_size[k], 
+                        b.linear_cut_ns[k], b.heap_cut_ns[k]);
+            }
+        }
+        // static lights stay where they were placed, they and their tree are only replaced once the 
+        // sliders are released (the tree is not built or cached for every step of a slider)
+        if (render_state.num_static_lights != prev.num_static_lights || (spot_changed && render_state.num_static_lights > 0))
+        {
+            static_lights_pending = true;
+        }
+        if (static_lights_pending && !render_state.static_lights_editing)
+        {
+            static_lights_pending = false;
+            scene.static_lights.clear();
+            add_random_lights(scene, render_state.num_static_lights, vec3(0), render_state.distance_from_origin, 
+                    render_state.spot_cone_angle, true);
+            build_static_light_tree(scene, render_state);
+            update_static_lights_version(scene); // uploads the lights and the tree
+        }
         // move lighs from origin if it was changed
         if (render_state.distance_from_origin != prev.distance_from_origin)
         {
@@ -227,6 +330,7 @@ int main()
             {
                 curr_camera->update(dt, window);
             }
+            render_state.time += dt;
             if (is_key_down(window, KEY_ARROW_UP))
             {
                 if (!is_key_down(window, KEY_SHIFT_L))
@@ -260,7 +364,7 @@ int main()
 
             if (is_key_pressed(window, KEY_EQUAL)) 
             {
-                render_state.num_samples = MIN(render_state.num_samples + 1, scene.lights.size());
+                render_state.num_samples = MIN(render_state.num_samples + 1, light_count(scene));
             }
             if (is_key_pressed(window, KEY_MINUS)) 
             {
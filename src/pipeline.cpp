@@ -302,8 +302,9 @@ bool build_graphics_pipeline(gpu_context_t& ctx, pipeline_description_t& desc, p
 	blend_info.flags = 0;
 	blend_info.logicOpEnable = VK_FALSE;
 	blend_info.logicOp = VK_LOGIC_OP_COPY;
-	blend_info.attachmentCount =  1;
-	blend_info.pAttachments = &blend_attachment;
+	std::vector<VkPipelineColorBlendAttachmentState> blend_attachments(desc.color_attachment_count, blend_attachment);
+	blend_info.attachmentCount = desc.color_attachment_count;
+	blend_info.pAttachments = blend_attachments.data();
 	blend_info.blendConstants[0] = 0.0f;
 	blend_info.blendConstants[1] = 0.0f;
 	blend_info.blendConstants[2] = 0.0f;
@@ -427,8 +428,34 @@ void add_shader(rt_pipeline_description_t& description, VkShaderStageFlagBits st
     }
 }
 
+void set_specialization_constant(rt_pipeline_description_t& description, u32 constant_id, u32 value)
+{
+    auto& entries = description.specialization_entries;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].constantID == constant_id)
+        {
+            description.specialization_data[i] = value;
+            return;
+        }
+    }
+
+    VkSpecializationMapEntry entry = {};
+    entry.constantID = constant_id;
+    entry.offset = static_cast<u32>(description.specialization_data.size() * sizeof(u32));
+    entry.size = sizeof(u32);
+    entries.push_back(entry);
+    description.specialization_data.push_back(value);
+}
+
 bool build_raytracing_pipeline(gpu_context_t& ctx, rt_pipeline_description_t& desc, pipeline_t* pipeline)
 {
+    VkSpecializationInfo specialization_info = {};
+    specialization_info.mapEntryCount = static_cast<u32>(desc.specialization_entries.size());
+    specialization_info.pMapEntries = desc.specialization_entries.data();
+    specialization_info.dataSize = desc.specialization_data.size() * sizeof(u32);
+    specialization_info.pData = desc.specialization_data.data();
+
 	std::vector<VkPipelineShaderStageCreateInfo> shader_stage_infos(desc.shaders.size());
 	std::vector<VkShaderModule> shader_modules(desc.shaders.size());
 
@@ -455,6 +482,7 @@ bool build_raytracing_pipeline(gpu_context_t& ctx, rt_pipeline_description_t& de
 		shader_stage_infos[i].stage = desc.shaders[i].stage;
 		shader_stage_infos[i].module = shader_modules[i];
 		shader_stage_infos[i].pName  = desc.shaders[i].entry.data();
+		shader_stage_infos[i].pSpecializationInfo = desc.specialization_entries.empty() ? nullptr : &specialization_info;
 	}
 	LOG_INFO("Shader modules loaded");
 
@@ -667,6 +695,7 @@ bool build_compute_pipeline(gpu_context_t& ctx, compute_pipeline_description_t&
 
     VK_CHECK( vkCreateComputePipelines(ctx.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline->handle) );
     vkDestroyShaderModule(ctx.device, shader_module, nullptr);
+    return true;
 }
 
 void destroy_pipeline(gpu_context_t& ctx, pipeline_t* pipeline)
@@ -31,6 +31,7 @@ struct pipeline_description_t
 	VkRect2D              sciccor;
     VkRenderPass          render_pass;
     bool                  color_blending = false;
+    u32                   color_attachment_count = 1; // same blend state for all of them
     bool                  depth_test = true;
     bool                  depth_write = true;
     std::vector<VkDynamicState> dynamic_states;
@@ -75,6 +76,9 @@ struct rt_pipeline_description_t
     std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
     std::vector<VkPushConstantRange>   push_constants;
     shader_binding_table_regions sbt_regions;
+    // specialization constants (32 bit) shared by all stages, ids a stage does not declare are ignored
+    std::vector<VkSpecializationMapEntry> specialization_entries;
+    std::vector<u32>                      specialization_data;
 };
 
 struct shader_binding_table_t
@@ -103,6 +107,7 @@ bool build_raytracing_pipeline(gpu_context_t& ctx, rt_pipeline_description_t& de
 bool build_shader_binding_table(gpu_context_t& ctx, rt_pipeline_description_t& description, pipeline_t& pipeline, shader_binding_table_t& sbt);
 void destroy_shader_binding_table(gpu_context_t& context, shader_binding_table_t& sbt);
 void add_shader(rt_pipeline_description_t& description, VkShaderStageFlagBits stage, std::string entry, const char* path);
+void set_specialization_constant(rt_pipeline_description_t& description, u32 constant_id, u32 value);
 
 bool build_compute_pipeline(gpu_context_t& ctx, compute_pipeline_description_t&, pipeline_t* pipeline);
 void add_shader(compute_pipeline_description_t& description, std::string entry, const char* path);
@@ -1,15 +1,42 @@
 #include "profiler.h"
 
-void init_profiler(VkDevice device, profiler_t& profiler)
+static u32 first_query(profiler_t& profiler, u32 frame, u32 queue)
 {
-    profiler.device = device;
-    profiler.query_count = 2;
+    return (frame * PROFILER_QUEUE_COUNT + queue) * profiler.query_count;
+}
+
+static void clear_frame(profiler_t& profiler, u32 frame)
+{
+    for (u32 q = 0; q < PROFILER_QUEUE_COUNT; q++)
+    {
+        profiler.timestamp_count[frame][q] = 0;
+        profiler.reset_pending[frame][q] = true;
+    }
+    profiler.active_queue[frame] = PROFILER_QUEUE_GRAPHICS;
+}
+
+void init_profiler(gpu_context_t& ctx, profiler_t& profiler)
+{
+    profiler.device = ctx.device;
+    profiler.query_count = MAX_TIMESTAMPS;
+    profiler.timestamp_period = static_cast<f64>(ctx.device_properties.limits.timestampPeriod);
+    profiler.queue_enabled[PROFILER_QUEUE_GRAPHICS] = ctx.q_graphics_timestamps;
+    profiler.queue_enabled[PROFILER_QUEUE_COMPUTE] = ctx.q_compute_timestamps;
+    for (u32 q = 0; q < PROFILER_QUEUE_COUNT; q++)
+    {
+        profiler.total[q] = 0.0;
+    }
+    for (u32 i = 0; i < BUFFERED_FRAMES; i++)
+    {
+        clear_frame(profiler, i);
+    }
+
     VkQueryPoolCreateInfo info = {};
     info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
     info.queryType = VK_QUERY_TYPE_TIMESTAMP;
-    info.queryCount = profiler.query_count; // I think 2 should be enough (reset every begin timer)
+    info.queryCount = profiler.query_count * PROFILER_QUEUE_COUNT * BUFFERED_FRAMES; // each frame and queue has its own range
 
-    VK_CHECK( vkCreateQueryPool(device, &info, nullptr, &profiler.query_pool) );
+    VK_CHECK( vkCreateQueryPool(ctx.device, &info, nullptr, &profiler.query_pool) );
 }
 
 void destroy_profiler(profiler_t& profiler)
@@ -17,24 +44,109 @@ void destroy_profiler(profiler_t& profiler)
     vkDestroyQueryPool(profiler.device, profiler.query_pool, nullptr);
 }
 
-void begin_timer(profiler_t& profiler, VkCommandBuffer cmd)
+void begin_timer(profiler_t& profiler, VkCommandBuffer cmd, u32 frame, u32 queue)
 {
-    vkCmdResetQueryPool(cmd, profiler.query_pool, 0, profiler.query_count);
-    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler.query_pool, 0);
+    profiler.active_queue[frame] = queue;
+    if (!profiler.queue_enabled[queue])
+    {
+        return;
+    }
+
+    u32 first = first_query(profiler, frame, queue);
+    // the range is reset by the first command buffer of the queue in this frame (same queue so it is ordered)
+    if (profiler.reset_pending[frame][queue])
+    {
+        vkCmdResetQueryPool(cmd, profiler.query_pool, first, profiler.query_count);
+        profiler.reset_pending[frame][queue] = false;
+    }
+
+    u32& count = profiler.timestamp_count[frame][queue];
+    if (count >= MAX_TIMESTAMPS)
+    {
+        LOG_ERROR("Too many timestamps in frame (max %d)", MAX_TIMESTAMPS);
+        return;
+    }
+    profiler.timestamp_names[frame][queue][count] = nullptr;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler.query_pool, first + count);
+    count++;
 }
 
-void end_timer(profiler_t& profiler, VkCommandBuffer cmd)
+void write_timestamp(profiler_t& profiler, VkCommandBuffer cmd, u32 frame, const char* name)
 {
-    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler.query_pool, 1);
+    u32 queue = profiler.active_queue[frame];
+    if (!profiler.queue_enabled[queue])
+    {
+        return;
+    }
+
+    u32& count = profiler.timestamp_count[frame][queue];
+    if (count >= MAX_TIMESTAMPS)
+    {
+        LOG_ERROR("Too many timestamps in frame (max %d)", MAX_TIMESTAMPS);
+        return;
+    }
+    profiler.timestamp_names[frame][queue][count] = name;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler.query_pool, first_query(profiler, frame, queue) + count);
+    count++;
+}
+
+void end_timer(profiler_t& profiler, VkCommandBuffer cmd, u32 frame)
+{
+    write_timestamp(profiler, cmd, frame, "other");
 }
 
-f64 get_results(profiler_t& profiler)
+bool read_timers(profiler_t& profiler, u32 frame)
 {
-    u64 data[2];
-    // todo do not wait
-    VK_CHECK( vkGetQueryPoolResults(profiler.device, profiler.query_pool, 0, profiler.query_count, 
-                sizeof(u64)*2, data, sizeof(u64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) );
-    u64 duration = data[1] - data[0];
-    return static_cast<f64>(duration) * 0.000001;
+    u64 data[PROFILER_QUEUE_COUNT][MAX_TIMESTAMPS];
+    bool has_results = false;
+    for (u32 q = 0; q < PROFILER_QUEUE_COUNT; q++)
+    {
+        u32 count = profiler.timestamp_count[frame][q];
+        if (count == 0)
+        {
+            continue;
+        }
+
+        VkResult res = vkGetQueryPoolResults(profiler.device, profiler.query_pool, first_query(profiler, frame, q), count,
+                sizeof(data[q]), data[q], sizeof(u64), VK_QUERY_RESULT_64_BIT);
+        if (res != VK_SUCCESS)
+        {
+            clear_frame(profiler, frame);
+            return false; // not ready, keep previous results
+        }
+        has_results = true;
+    }
+    if (!has_results)
+    {
+        clear_frame(profiler, frame);
+        return false;
+    }
+
+    // durations are only taken between timestamps of the same command buffer
+    profiler.results.clear();
+    for (u32 q = 0; q < PROFILER_QUEUE_COUNT; q++)
+    {
+        profiler.total[q] = 0.0;
+        for (u32 i = 1; i < profiler.timestamp_count[frame][q]; i++)
+        {
+            const char* name = profiler.timestamp_names[frame][q][i];
+            if (name == nullptr)
+            {
+                continue; // begin of the next command buffer
+            }
+            timestamp_t timestamp;
+            timestamp.name = name;
+            timestamp.ms = static_cast<f64>(data[q][i] - data[q][i - 1]) * profiler.timestamp_period * 0.000001;
+            timestamp.queue = q;
+            profiler.results.push_back(timestamp);
+            profiler.total[q] += timestamp.ms;
+        }
+    }
+    clear_frame(profiler, frame);
+    return true;
 }
 
+f64 get_results(profiler_t& profiler, u32 queue)
+{
+    return profiler.total[queue];
+}
@@ -3,19 +3,58 @@
 
 #include "backend.h"
 
+#include <vector>
+
+// max timestamps of one queue in one frame (including the begin of each command buffer)
+#define MAX_TIMESTAMPS 32
+
+// timestamps can only be compared within one queue, so every queue has its own range of queries
+#define PROFILER_QUEUE_GRAPHICS 0
+#define PROFILER_QUEUE_COMPUTE  1
+#define PROFILER_QUEUE_COUNT    2
+
+struct timestamp_t
+{
+    const char* name;
+    f64 ms; // time since the previous timestamp in the same command buffer
+    u32 queue;
+};
+
 struct profiler_t
 {
     VkDevice device;
     VkQueryPool query_pool;
-    u32 query_count;
+    u32 query_count; // per queue and buffered frame
+    f64 timestamp_period; // ns per tick
+    bool queue_enabled[PROFILER_QUEUE_COUNT]; // queue family has valid timestamp bits
+
+    // timestamps recorded for each buffered frame and queue, the first timestamp of 
+    // every command buffer has no name (begin_timer)
+    u32 active_queue[BUFFERED_FRAMES];
+    bool reset_pending[BUFFERED_FRAMES][PROFILER_QUEUE_COUNT];
+    u32 timestamp_count[BUFFERED_FRAMES][PROFILER_QUEUE_COUNT];
+    const char* timestamp_names[BUFFERED_FRAMES][PROFILER_QUEUE_COUNT][MAX_TIMESTAMPS];
+
+    // results of the last frame read back
+    std::vector<timestamp_t> results;
+    f64 total[PROFILER_QUEUE_COUNT];
 };
 
-void init_profiler(VkDevice device, profiler_t& profiler);
+void init_profiler(gpu_context_t& ctx, profiler_t& profiler);
 void destroy_profiler(profiler_t& profiler);
-void begin_timer(profiler_t& profiler, VkCommandBuffer cmd);
 
-// return ms
-void end_timer(profiler_t& profiler, VkCommandBuffer cmd);
-f64 get_results(profiler_t& profiler);
+// begins timing a command buffer that is submitted to the given queue, the time between 
+// command buffers (waits and other work on the queue) is not counted
+void begin_timer(profiler_t& profiler, VkCommandBuffer cmd, u32 frame, u32 queue);
+
+// marks the end of a stage (time is measured from the previous timestamp)
+void write_timestamp(profiler_t& profiler, VkCommandBuffer cmd, u32 frame, const char* name);
+void end_timer(profiler_t& profiler, VkCommandBuffer cmd, u32 frame);
+
+// reads the timestamps of a frame and starts new ranges for it, only call after the frame fence was waited on
+bool read_timers(profiler_t& profiler, u32 frame);
+
+// return ms (sum of the timed command buffers of the queue)
+f64 get_results(profiler_t& profiler, u32 queue);
 
 #endif // PROFILE_H
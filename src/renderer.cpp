@@ -6,8 +6,11 @@
 #include "time.h"
 #include "window.h"
 #include "ui.h"
+#include "light_tree.h"
+#include "blue_noise.h"
 
 #include <cassert>
+#include <cstddef>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 #define NOMINMAX
@@ -64,10 +67,45 @@ struct batch_t
     u32 mesh_id;
 };
 
+// number of workgroups needed to process count items
+static inline u32 group_count(u32 count, u32 local_size)
+{
+    return MAX((count + local_size - 1) / local_size, 1u);
+}
+
+// levels of the radix scan for capacity lights (see radix_sort_scan.inc), 
+// num_sums receives the number of block totals stored for the levels > 0
+static u32 radix_scan_levels(u32 capacity, u32* num_sums = nullptr)
+{
+    u32 count = group_count(capacity, RADIX_SORT_BLOCK_SIZE) * RADIX_SORT_BUCKETS;
+    u32 levels = 1;
+    u32 sums = 0;
+    while (count > RADIX_SCAN_BLOCK_SIZE)
+    {
+        count = group_count(count, RADIX_SCAN_BLOCK_SIZE);
+        sums += count;
+        levels++;
+    }
+    assert(levels <= RADIX_SCAN_MAX_LEVELS);
+    if (num_sums) *num_sums = sums;
+    return levels;
+}
+
+// wait for the previous compute dispatch to finish writing
+static inline void compute_barrier(VkCommandBuffer cmd)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
 void renderer_t::create_prepass_render_pass()
 {
     // create render pass;
-	VkAttachmentDescription attachment[2] = {};
+	VkAttachmentDescription attachment[4] = {};
     // depth
 	attachment[0].format         = VK_FORMAT_D32_SFLOAT; 
 	attachment[0].samples        = VK_SAMPLE_COUNT_1_BIT;
@@ -78,7 +116,7 @@ void renderer_t::create_prepass_render_pass()
 	attachment[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
 	attachment[0].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
-    // albedo
+    // world normal
 	attachment[1].format         = VK_FORMAT_R32G32B32A32_SFLOAT; 
 	attachment[1].samples        = VK_SAMPLE_COUNT_1_BIT;
 	attachment[1].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -86,25 +124,49 @@ void renderer_t::create_prepass_render_pass()
 	attachment[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachment[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachment[1].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachment[1].finalLayout    = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachment[1].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    // motion vectors (temporal accumulation)
+	attachment[2].format         = VK_FORMAT_R16G16_SFLOAT; 
+	attachment[2].samples        = VK_SAMPLE_COUNT_1_BIT;
+	attachment[2].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment[2].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment[2].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment[2].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment[2].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    // albedo (denoiser)
+	attachment[3].format         = VK_FORMAT_R8G8B8A8_UNORM; 
+	attachment[3].samples        = VK_SAMPLE_COUNT_1_BIT;
+	attachment[3].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment[3].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment[3].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference depth_ref =  {};
     depth_ref.attachment = 0;
     depth_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     
-	VkAttachmentReference color_ref =  {};
-    color_ref.attachment = 1;
-    color_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	VkAttachmentReference color_ref[3] =  {};
+    color_ref[0].attachment = 1;
+    color_ref[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_ref[1].attachment = 2;
+    color_ref[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_ref[2].attachment = 3;
+    color_ref[2].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.inputAttachmentCount    = 0;
-	subpass.colorAttachmentCount    = 1;
-    subpass.pColorAttachments       = &color_ref;
+	subpass.colorAttachmentCount    = 3;
+    subpass.pColorAttachments       = color_ref;
 	subpass.pDepthStencilAttachment = &depth_ref;
 
-    VkSubpassDependency dependencies[3] = {};
+    VkSubpassDependency dependencies[4] = {};
 	dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
 	dependencies[0].dstSubpass      = 0;
 	dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
@@ -129,14 +191,23 @@ void renderer_t::create_prepass_render_pass()
 	dependencies[2].dstAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	dependencies[2].dependencyFlags = 0;
 
+    // depth, normals, motion vectors and albedo are read by light_cut_tiles.comp, temporal_accumulation.comp and svgf
+    dependencies[3].srcSubpass      = 0;
+    dependencies[3].dstSubpass      = VK_SUBPASS_EXTERNAL;
+    dependencies[3].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[3].dstStageMask    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[3].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[3].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[3].dependencyFlags = 0;
+
 
 	VkRenderPassCreateInfo create_info = {};
 	create_info.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	create_info.attachmentCount = 2;
+	create_info.attachmentCount = 4;
 	create_info.pAttachments    = attachment;
 	create_info.subpassCount    = 1;
 	create_info.pSubpasses      = &subpass;
-	create_info.dependencyCount = 3;
+	create_info.dependencyCount = 4;
 	create_info.pDependencies   = dependencies;
 
 	VK_CHECK( vkCreateRenderPass(context.device, &create_info, nullptr, &prepass_render_pass) );
@@ -161,11 +232,25 @@ void renderer_t::create_prepass_render_pass()
                 &color_attachment[i]);
         create_sampler(context, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, &color_sampler[i]);
 
-        VkImageView views[2] = { depth_attachment[i].view, color_attachment[i].view };
+        // motion (sampled with color_sampler)
+        create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R16G16_SFLOAT,
+                context.swapchain.extent.width, context.swapchain.extent.height,
+                VkImageUsageFlagBits(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                &motion_attachment[i]);
+
+        // albedo (sampled with color_sampler)
+        create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R8G8B8A8_UNORM,
+                context.swapchain.extent.width, context.swapchain.extent.height,
+                VkImageUsageFlagBits(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                &albedo_attachment[i]);
+
+        VkImageView views[4] = { depth_attachment[i].view, color_attachment[i].view, motion_attachment[i].view, albedo_attachment[i].view };
 		VkFramebufferCreateInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		info.renderPass = prepass_render_pass;
-		info.attachmentCount = 2;
+		info.attachmentCount = 4;
 		info.pAttachments = views;
 		info.width  = context.swapchain.extent.width;
 		info.height = context.swapchain.extent.height;
@@ -278,7 +363,7 @@ void renderer_t::create_bbox_render_pass()
 renderer_t::renderer_t(window_t* _window) : window(_window)
 {
     init_context(context, window);
-    init_profiler(context.device, profiler);
+    init_profiler(context, profiler);
     init_staging_buffer(staging, &context);
     init_descriptor_allocator(context.device, MAX_DESCRIPTOR_SETS,  &descriptor_allocator);
     frame_resources.resize(context.frames.size());
@@ -287,14 +372,21 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
     
     // create descriptor layouts for pipelines
     // set 0 
-    set_layouts.resize(9);
+    set_layouts.resize(13);
     auto& layout_set0 = set_layouts[0];
-    add_binding(layout_set0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+    add_binding(layout_set0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     add_binding(layout_set0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     add_binding(layout_set0, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT   | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     add_binding(layout_set0, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     add_binding(layout_set0, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
     add_binding(layout_set0, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+    add_binding(layout_set0, 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // wide light tree
+    add_binding(layout_set0, 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // quantized light tree
+    add_binding(layout_set0, 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // static light tree
+    add_binding(layout_set0, 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // tile light cuts
+    add_binding(layout_set0, 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // blue noise
+    add_binding(layout_set0, 11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // reservoirs
+    add_binding(layout_set0, 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR); // reservoirs of the previous frame
     build_descriptor_set_layout(context.device, layout_set0);
     // set 1
     auto& layout_set1 = set_layouts[1];
@@ -310,22 +402,38 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
     auto& layout_set3 = set_layouts[3];
     add_binding(layout_set3, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
     add_binding(layout_set3, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
-    add_binding(layout_set3, 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    add_binding(layout_set3, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light bounds
+    add_binding(layout_set3, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // partial light bounds
+    add_binding(layout_set3, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light animation groups
+    add_binding(layout_set3, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light dispatch
     build_descriptor_set_layout(context.device, layout_set3);
     // set 4 (sort)
     auto& layout_set4 = set_layouts[4];
     add_binding(layout_set4, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    add_binding(layout_set4, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light dispatch
     build_descriptor_set_layout(context.device, layout_set4);
     // set 5 (tree builder)
     auto& layout_set5 = set_layouts[5];
     add_binding(layout_set5, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
     add_binding(layout_set5, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
     add_binding(layout_set5, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    add_binding(layout_set5, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // lbvh parents
+    add_binding(layout_set5, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // lbvh flags
+    add_binding(layout_set5, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // tree cost
+    add_binding(layout_set5, 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // wide tree
+    add_binding(layout_set5, 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // traversal benchmark
+    add_binding(layout_set5, 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // quantized tree
+    add_binding(layout_set5, 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // static tree
+    add_binding(layout_set5, 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // tree validation result
+    add_binding(layout_set5, 11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // tree validation light ids
+    add_binding(layout_set5, 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light dispatch
     build_descriptor_set_layout(context.device, layout_set5);
     // set 6 (write vbo lines compute shader)
     auto& layout_set6 = set_layouts[6];
     add_binding(layout_set6, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
     add_binding(layout_set6, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    add_binding(layout_set6, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // lbvh parents
+    add_binding(layout_set6, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light dispatch
     build_descriptor_set_layout(context.device, layout_set6);
     // set 7 (debugging info)
     auto& layout_set7 = set_layouts[7];
@@ -338,6 +446,51 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
     auto& layout_set8 = set_layouts[8];
     add_binding(layout_set8, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
     build_descriptor_set_layout(context.device, layout_set8);
+    // set 9 (radix sort)
+    auto& layout_set9 = set_layouts[9];
+    add_binding(layout_set9, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // src
+    add_binding(layout_set9, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // dst
+    add_binding(layout_set9, 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // histogram
+    add_binding(layout_set9, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light dispatch
+    add_binding(layout_set9, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // scan block totals
+    build_descriptor_set_layout(context.device, layout_set9);
+    // set 10 (tile light cuts)
+    auto& layout_set10 = set_layouts[10];
+    add_binding(layout_set10, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // camera
+    add_binding(layout_set10, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass depth
+    add_binding(layout_set10, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass normals
+    add_binding(layout_set10, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // tile light cuts
+    add_binding(layout_set10, 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // light tree
+    add_binding(layout_set10, 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // wide light tree
+    add_binding(layout_set10, 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // quantized light tree
+    add_binding(layout_set10, 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // static light tree
+    build_descriptor_set_layout(context.device, layout_set10);
+    // set 11 (temporal accumulation)
+    auto& layout_set11 = set_layouts[11];
+    add_binding(layout_set11, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // camera
+    add_binding(layout_set11, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass depth
+    add_binding(layout_set11, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass normals
+    add_binding(layout_set11, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass motion
+    add_binding(layout_set11, 4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // ray traced image
+    add_binding(layout_set11, 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // previous history color
+    add_binding(layout_set11, 6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // previous history geometry
+    add_binding(layout_set11, 7, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // history color
+    add_binding(layout_set11, 8, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // history geometry
+    add_binding(layout_set11, 9, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // previous history moments
+    add_binding(layout_set11, 10, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // history moments
+    build_descriptor_set_layout(context.device, layout_set11);
+    // set 12 (svgf)
+    auto& layout_set12 = set_layouts[12];
+    add_binding(layout_set12, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // camera
+    add_binding(layout_set12, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass depth
+    add_binding(layout_set12, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass normals
+    add_binding(layout_set12, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // prepass albedo
+    add_binding(layout_set12, 4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // accumulated image
+    add_binding(layout_set12, 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // history color
+    add_binding(layout_set12, 6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // history moments
+    add_binding(layout_set12, 7, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // filter input
+    add_binding(layout_set12, 8, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT); // filter output
+    build_descriptor_set_layout(context.device, layout_set12);
     
     // create prepass pipeline
     {
@@ -346,13 +499,14 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
         add_shader(pipeline_description, VK_SHADER_STAGE_VERTEX_BIT,   "main", "shaders/prepass.vert.spv");
         add_shader(pipeline_description, VK_SHADER_STAGE_FRAGMENT_BIT,   "main", "shaders/prepass.frag.spv");
         pipeline_description.render_pass = prepass_render_pass;
+        pipeline_description.color_attachment_count = 3; // normals, motion vectors and albedo
         prepass_pipeline.descriptor_set_layouts.push_back(layout_set0.handle); // dont care
         build_graphics_pipeline(context, pipeline_description, prepass_pipeline);
     }
 
-    // create rt pipeline
+    // describe the rt pipeline, the variants are built on first use (get_rtx_variant)
     {
-        rt_pipeline_description_t rt_pipeline_description;
+        rt_pipeline_description_t& rt_pipeline_description = rtx_description;
         add_shader(rt_pipeline_description, VK_SHADER_STAGE_RAYGEN_BIT_KHR, "main", "shaders/raytracing.rgen.spv");
         add_shader(rt_pipeline_description, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main", "shaders/raytracing.rchit.spv");
         add_shader(rt_pipeline_description, VK_SHADER_STAGE_MISS_BIT_KHR, "main", "shaders/raytracing.rmiss.spv");
@@ -379,12 +533,10 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
         rt_pipeline_description.descriptor_set_layouts.push_back(layout_set0.handle);
         rt_pipeline_description.descriptor_set_layouts.push_back(layout_set1.handle);
         rt_pipeline_description.descriptor_set_layouts.push_back(layout_set7.handle); // debuging lines
-        build_raytracing_pipeline(context, rt_pipeline_description, &rtx_pipeline);
         // set region from group indices (todo: payloads)
         rt_pipeline_description.sbt_regions[RGEN_REGION] = {0};
         rt_pipeline_description.sbt_regions[CHIT_REGION] = {3};
         rt_pipeline_description.sbt_regions[MISS_REGION] = {1,2};
-        build_shader_binding_table(context, rt_pipeline_description, rtx_pipeline, sbt);
     }
 
     // create hit query pipeline (there is no query support for 1060 6gb)
@@ -421,6 +573,33 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
         build_shader_binding_table(context, rt_pipeline_description, query_pipeline, query_sbt);
     }
 
+    // create light animation pipeline
+    {
+        LOG_INFO("Create light animation pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_animate.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set3.handle);
+        build_compute_pipeline(context, compute_description, &light_animate_compute_pipeline);
+    }
+
+    // create light dispatch pipeline
+    {
+        LOG_INFO("Create light dispatch pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_dispatch.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set3.handle);
+        build_compute_pipeline(context, compute_description, &light_dispatch_compute_pipeline);
+    }
+
+    // create light bounds reduction pipeline
+    {
+        LOG_INFO("Create light bounds pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_bounds.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set3.handle);
+        build_compute_pipeline(context, compute_description, &light_bounds_compute_pipeline);
+    }
+
     // create morton encoder pipeline
     {
         LOG_INFO("Create morton encoder pipeline");
@@ -439,6 +618,30 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
         build_compute_pipeline(context, compute_description, &sort_compute_pipeline);
     }
 
+    // create radix sort pipelines
+    {
+        LOG_INFO("Create radix sort pipelines");
+        compute_pipeline_description_t histogram_description;
+        add_shader(histogram_description, "main", "shaders/radix_sort_histogram.comp.spv");
+        histogram_description.descriptor_set_layouts.push_back(layout_set9.handle);
+        build_compute_pipeline(context, histogram_description, &radix_histogram_pipeline);
+
+        compute_pipeline_description_t scan_description;
+        add_shader(scan_description, "main", "shaders/radix_sort_scan.comp.spv");
+        scan_description.descriptor_set_layouts.push_back(layout_set9.handle);
+        build_compute_pipeline(context, scan_description, &radix_scan_pipeline);
+
+        compute_pipeline_description_t scan_add_description;
+        add_shader(scan_add_description, "main", "shaders/radix_sort_scan_add.comp.spv");
+        scan_add_description.descriptor_set_layouts.push_back(layout_set9.handle);
+        build_compute_pipeline(context, scan_add_description, &radix_scan_add_pipeline);
+
+        compute_pipeline_description_t scatter_description;
+        add_shader(scatter_description, "main", "shaders/radix_sort_scatter.comp.spv");
+        scatter_description.descriptor_set_layouts.push_back(layout_set9.handle);
+        build_compute_pipeline(context, scatter_description, &radix_scatter_pipeline);
+    }
+
     // create tree leaves builder pipeline
     {
         LOG_INFO("Create leaf nodes pipeline");
@@ -456,6 +659,98 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
         compute_description.descriptor_set_layouts.push_back(layout_set5.handle);
         build_compute_pipeline(context, compute_description, &tree_compute_pipeline);
     }
+
+    // create fused tree builder pipeline
+    {
+        LOG_INFO("Create fused light tree pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_tree_fused.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, compute_description, &tree_fused_compute_pipeline);
+    }
+
+    // create lbvh builder pipelines
+    {
+        LOG_INFO("Create lbvh pipelines");
+        compute_pipeline_description_t internal_description;
+        add_shader(internal_description, "main", "shaders/light_tree_lbvh_internal.comp.spv");
+        internal_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, internal_description, &lbvh_internal_compute_pipeline);
+
+        compute_pipeline_description_t bounds_description;
+        add_shader(bounds_description, "main", "shaders/light_tree_lbvh_bounds.comp.spv");
+        bounds_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, bounds_description, &lbvh_bounds_compute_pipeline);
+    }
+
+    // create wide tree pipelines
+    {
+        LOG_INFO("Create wide light tree pipelines");
+        compute_pipeline_description_t wide_description;
+        add_shader(wide_description, "main", "shaders/light_tree_wide.comp.spv");
+        wide_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, wide_description, &tree_wide_compute_pipeline);
+
+        compute_pipeline_description_t quant_description;
+        add_shader(quant_description, "main", "shaders/light_tree_quant.comp.spv");
+        quant_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, quant_description, &tree_quant_compute_pipeline);
+
+        compute_pipeline_description_t traversal_description;
+        add_shader(traversal_description, "main", "shaders/light_tree_traversal.comp.spv");
+        traversal_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, traversal_description, &traversal_compute_pipeline);
+    }
+
+    // create tree cost pipeline
+    {
+        LOG_INFO("Create light tree cost pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_tree_cost.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, compute_description, &tree_cost_compute_pipeline);
+    }
+
+    // create light tree validation pipeline
+    {
+        LOG_INFO("Create light tree validation pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_tree_validate.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set5.handle);
+        build_compute_pipeline(context, compute_description, &tree_validate_compute_pipeline);
+    }
+
+    // create tile light cuts pipeline
+    {
+        LOG_INFO("Create tile light cuts pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/light_cut_tiles.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set10.handle);
+        build_compute_pipeline(context, compute_description, &light_cut_tiles_compute_pipeline);
+    }
+
+    // create temporal accumulation pipeline
+    {
+        LOG_INFO("Create temporal accumulation pipeline");
+        compute_pipeline_description_t compute_description;
+        add_shader(compute_description, "main", "shaders/temporal_accumulation.comp.spv");
+        compute_description.descriptor_set_layouts.push_back(layout_set11.handle);
+        build_compute_pipeline(context, compute_description, &temporal_accumulation_compute_pipeline);
+    }
+
+    // create svgf denoiser pipelines
+    {
+        LOG_INFO("Create svgf pipelines");
+        compute_pipeline_description_t variance_description;
+        add_shader(variance_description, "main", "shaders/svgf_variance.comp.spv");
+        variance_description.descriptor_set_layouts.push_back(layout_set12.handle);
+        build_compute_pipeline(context, variance_description, &svgf_variance_compute_pipeline);
+
+        compute_pipeline_description_t atrous_description;
+        add_shader(atrous_description, "main", "shaders/svgf_atrous.comp.spv");
+        atrous_description.descriptor_set_layouts.push_back(layout_set12.handle);
+        build_compute_pipeline(context, atrous_description, &svgf_atrous_compute_pipeline);
+    }
     
     // create post-process pipeline(s)
     {
@@ -525,6 +820,160 @@ renderer_t::renderer_t(window_t* _window) : window(_window)
 }
 
 
+static void destroy_light_buffers(gpu_context_t& context, frame_resource_t& f)
+{
+    destroy_buffer(context, f.ubo_light);
+    destroy_buffer(context, f.sbo_encoded_lights);
+    destroy_buffer(context, f.sbo_encoded_lights_tmp);
+    destroy_buffer(context, f.sbo_radix_histogram);
+    destroy_buffer(context, f.sbo_radix_scan_sums);
+    destroy_buffer(context, f.sbo_light_tree);
+    destroy_buffer(context, f.sbo_light_tree_parents);
+    destroy_buffer(context, f.sbo_light_tree_flags);
+    destroy_buffer(context, f.sbo_light_tree_cost);
+    destroy_buffer(context, f.sbo_light_tree_wide);
+    destroy_buffer(context, f.sbo_light_tree_quant);
+    destroy_buffer(context, f.sbo_nodes_highlight);
+    destroy_buffer(context, f.sbo_leaf_select);
+    destroy_buffer(context, f.sbo_light_bounds_partial);
+    destroy_buffer(context, f.sbo_light_tree_static);
+    destroy_buffer(context, f.sbo_tree_validation_ids);
+}
+
+// (Re)creates the buffers that scale with the number of lights and writes them into
+// the descriptor sets of the frame. The frame must not be in flight.
+void renderer_t::resize_light_buffers(frame_resource_t& resource, u32 capacity)
+{
+    if (resource.light_capacity > 0)
+    {
+        destroy_light_buffers(context, resource);
+    }
+    LOG_INFO("Light buffers resized to %u lights", capacity);
+
+    u32 tree_size = 2 * capacity;
+    u32 radix_blocks = (capacity + RADIX_SORT_BLOCK_SIZE - 1) / RADIX_SORT_BLOCK_SIZE;
+    u32 radix_scan_sums = 0;
+    radix_scan_levels(capacity, &radix_scan_sums);
+    // used as vbo for visualizing
+    create_buffer(context, capacity * sizeof(light_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &resource.ubo_light);
+    create_buffer(context, capacity * sizeof(encoded_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &resource.sbo_encoded_lights);
+    create_buffer(context, capacity * sizeof(encoded_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_encoded_lights_tmp);
+    create_buffer(context, radix_blocks * RADIX_SORT_BUCKETS * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_radix_histogram);
+    create_buffer(context, MAX(radix_scan_sums, 1u) * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_radix_scan_sums);
+    create_buffer(context, tree_size * sizeof(node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &resource.sbo_light_tree);
+    create_buffer(context, (capacity / 3 + 1) * sizeof(wide_node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_light_tree_wide);
+    create_buffer(context, tree_size * sizeof(quant_node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &resource.sbo_light_tree_quant);
+    create_buffer(context, tree_size * sizeof(node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_light_tree_static);
+    create_buffer(context, tree_size * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_light_tree_parents);
+    create_buffer(context, capacity * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &resource.sbo_light_tree_flags);
+    create_buffer(context, (2 + tree_size / 512) * sizeof(f32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_light_tree_cost,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    create_buffer(context, tree_size * sizeof(i32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &resource.sbo_nodes_highlight);
+    create_buffer(context, capacity * sizeof(i32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &resource.sbo_leaf_select);
+    create_buffer(context, group_count(capacity, LIGHT_BOUNDS_BLOCK_SIZE) * 2 * sizeof(v4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_light_bounds_partial);
+    create_buffer(context, capacity * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &resource.sbo_tree_validation_ids);
+
+    VkDescriptorBufferInfo ubo_light_info = { resource.ubo_light.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_encoded_lights_info = { resource.sbo_encoded_lights.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_encoded_lights_tmp_info = { resource.sbo_encoded_lights_tmp.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo radix_histogram_info = { resource.sbo_radix_histogram.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo radix_scan_sums_info = { resource.sbo_radix_scan_sums.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_light_tree_info = { resource.sbo_light_tree.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_light_tree_wide_info = { resource.sbo_light_tree_wide.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_light_tree_quant_info = { resource.sbo_light_tree_quant.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo sbo_light_tree_static_info = { resource.sbo_light_tree_static.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo light_tree_parents_info = { resource.sbo_light_tree_parents.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo light_tree_flags_info = { resource.sbo_light_tree_flags.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo light_tree_cost_info = { resource.sbo_light_tree_cost.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo nodes_highlight_info = { resource.sbo_nodes_highlight.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo selected_leafs_info = { resource.sbo_leaf_select.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo light_bounds_partial_info = { resource.sbo_light_bounds_partial.handle, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo tree_validation_ids_info = { resource.sbo_tree_validation_ids.handle, 0, VK_WHOLE_SIZE };
+
+    auto& sets = resource.descriptor_sets;
+    descriptor_set_t set0(set_layouts[0]);
+    bind_buffer(set0, 1, &ubo_light_info);
+    bind_buffer(set0, 5, &sbo_light_tree_info);
+    bind_buffer(set0, 6, &sbo_light_tree_wide_info);
+    bind_buffer(set0, 7, &sbo_light_tree_quant_info);
+    bind_buffer(set0, 8, &sbo_light_tree_static_info);
+    update_descriptor_set(context.device, set0, sets[0]);
+
+    // (light bounds and morton encode)
+    descriptor_set_t set3(set_layouts[3]);
+    bind_buffer(set3, 0, &ubo_light_info);
+    bind_buffer(set3, 1, &sbo_encoded_lights_info);
+    bind_buffer(set3, 3, &light_bounds_partial_info);
+    update_descriptor_set(context.device, set3, sets[3]);
+
+    // (sorter)
+    descriptor_set_t set4(set_layouts[4]);
+    bind_buffer(set4, 0, &sbo_encoded_lights_info);
+    update_descriptor_set(context.device, set4, sets[4]);
+
+    // (tree builder)
+    descriptor_set_t set5(set_layouts[5]);
+    bind_buffer(set5, 0, &ubo_light_info);
+    bind_buffer(set5, 1, &sbo_encoded_lights_info);
+    bind_buffer(set5, 2, &sbo_light_tree_info);
+    bind_buffer(set5, 3, &light_tree_parents_info);
+    bind_buffer(set5, 4, &light_tree_flags_info);
+    bind_buffer(set5, 5, &light_tree_cost_info);
+    bind_buffer(set5, 6, &sbo_light_tree_wide_info);
+    bind_buffer(set5, 8, &sbo_light_tree_quant_info);
+    bind_buffer(set5, 9, &sbo_light_tree_static_info);
+    bind_buffer(set5, 11, &tree_validation_ids_info);
+    update_descriptor_set(context.device, set5, sets[5]);
+
+    // (bbox lines)
+    descriptor_set_t set7(set_layouts[6]);
+    bind_buffer(set7, 0, &sbo_light_tree_info);
+    bind_buffer(set7, 2, &light_tree_parents_info);
+    update_descriptor_set(context.device, set7, sets[7]);
+
+    // (debugging info)
+    descriptor_set_t set8(set_layouts[7]);
+    bind_buffer(set8, 2, &nodes_highlight_info);
+    bind_buffer(set8, 3, &selected_leafs_info);
+    update_descriptor_set(context.device, set8, sets[8]);
+
+    descriptor_set_t set9(set_layouts[8]);
+    bind_buffer(set9, 0, &nodes_highlight_info);
+    update_descriptor_set(context.device, set9, sets[9]);
+
+    // (radix sort)
+    descriptor_set_t set10(set_layouts[9]);
+    bind_buffer(set10, 0, &sbo_encoded_lights_info);
+    bind_buffer(set10, 1, &sbo_encoded_lights_tmp_info);
+    bind_buffer(set10, 2, &radix_histogram_info);
+    bind_buffer(set10, 4, &radix_scan_sums_info);
+    update_descriptor_set(context.device, set10, sets[10]);
+
+    descriptor_set_t set11(set_layouts[9]);
+    bind_buffer(set11, 0, &sbo_encoded_lights_tmp_info);
+    bind_buffer(set11, 1, &sbo_encoded_lights_info);
+    bind_buffer(set11, 2, &radix_histogram_info);
+    bind_buffer(set11, 4, &radix_scan_sums_info);
+    update_descriptor_set(context.device, set11, sets[11]);
+
+    // (tile light cuts)
+    descriptor_set_t set12(set_layouts[10]);
+    bind_buffer(set12, 5, &sbo_light_tree_info);
+    bind_buffer(set12, 6, &sbo_light_tree_wide_info);
+    bind_buffer(set12, 7, &sbo_light_tree_quant_info);
+    bind_buffer(set12, 8, &sbo_light_tree_static_info);
+    update_descriptor_set(context.device, set12, sets[12]);
+
+    // nothing of the previous lights or tree is left
+    resource.light_capacity = capacity;
+    resource.lights_version = 0;
+    resource.static_lights_version = 0;
+    resource.tree_num_lights = -1;
+    resource.tree_type = -1;
+    resource.tree_cost_written = false;
+    resource.tree_validated = false;
+}
+
 // Creates the descriptor sets and their respective buffers and images
 void renderer_t::update_descriptors(scene_t& scene)
 {
@@ -534,32 +983,64 @@ void renderer_t::update_descriptors(scene_t& scene)
     // debug rays info buffer
     create_buffer(context, sizeof(query_output_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &ray_lines_info);
         VkDescriptorBufferInfo ray_lines_info_info = { ray_lines_info.handle, 0, VK_WHOLE_SIZE };
+
+    // blue noise tile of the light selection, generated once
+    std::vector<f32> blue_noise;
+    generate_blue_noise(BLUE_NOISE_SIZE, 1, blue_noise);
+    u32 blue_noise_size = static_cast<u32>(blue_noise.size() * sizeof(f32));
+    create_buffer(context, blue_noise_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &sbo_blue_noise);
+    copy_to_buffer(staging, sbo_blue_noise, blue_noise_size, (void*)blue_noise.data(), 0);
+    VkDescriptorBufferInfo blue_noise_info = { sbo_blue_noise.handle, 0, VK_WHOLE_SIZE };
+
+    // history of the temporal accumulation, created first since every frame reads the one of the previous frame
+    for (size_t i = 0; i < context.frames.size(); ++i)
+    {
+        create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, context.swapchain.extent.width, context.swapchain.extent.height, 
+                VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &frame_resources[i].history_color);
+        create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, context.swapchain.extent.width, context.swapchain.extent.height, 
+                VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &frame_resources[i].history_geometry);
+        create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, context.swapchain.extent.width, context.swapchain.extent.height, 
+                VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &frame_resources[i].history_moments);
+        for (u32 j = 0; j < 2; ++j)
+        {
+            create_image(context, VK_IMAGE_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, context.swapchain.extent.width, context.swapchain.extent.height, 
+                    VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &frame_resources[i].svgf_filter[j]);
+        }
+        u64 num_pixels = static_cast<u64>(context.swapchain.extent.width) * context.swapchain.extent.height;
+        create_buffer(context, num_pixels * sizeof(reservoir_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_reservoirs);
+    }
     for (size_t i = 0; i < context.frames.size(); ++i)
     {
         // set 0
         create_buffer(context, sizeof(camera_ubo_t), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &frame_resources[i].ubo_camera);
-        // used as vbo for visualizing
-        create_buffer(context, MAX_LIGHTS * sizeof(light_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &frame_resources[i].ubo_light); 
         create_buffer(context, MAX_ENTITIES * sizeof(model_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].ubo_model); 
         create_buffer(context, MAX_ENTITIES * sizeof(material_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_material);
         create_buffer(context, MAX_ENTITIES * sizeof(mesh_info_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_meshes);
 
         VkDescriptorBufferInfo ubo_camera_info = { frame_resources[i].ubo_camera.handle, 0, VK_WHOLE_SIZE };
-        VkDescriptorBufferInfo ubo_light_info  = { frame_resources[i].ubo_light.handle,  0, VK_WHOLE_SIZE };
         VkDescriptorBufferInfo ubo_model_info  = { frame_resources[i].ubo_model.handle,  0, VK_WHOLE_SIZE };
         VkDescriptorBufferInfo sbo_material_info = { frame_resources[i].sbo_material.handle, 0, VK_WHOLE_SIZE };
         VkDescriptorBufferInfo sbo_meshes_info = { frame_resources[i].sbo_meshes.handle, 0, VK_WHOLE_SIZE };
 
-        create_buffer(context, MAX_LIGHT_TREE_SIZE * sizeof(node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &frame_resources[i].sbo_light_tree);
-        VkDescriptorBufferInfo sbo_light_tree_info = { frame_resources[i].sbo_light_tree.handle, 0, VK_WHOLE_SIZE };
+        u32 num_tiles = group_count(context.swapchain.extent.width, LIGHT_CUT_TILE_SIZE) * group_count(context.swapchain.extent.height, LIGHT_CUT_TILE_SIZE);
+        create_buffer(context, num_tiles * sizeof(tile_cut_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_tile_cuts);
+        VkDescriptorBufferInfo tile_cuts_info = { frame_resources[i].sbo_tile_cuts.handle, 0, VK_WHOLE_SIZE };
 
+        // frames are used in order, the previous frame is the one before i (reservoirs and accumulation history)
+        auto& prev_resource = frame_resources[(i + context.frames.size() - 1) % context.frames.size()];
+        VkDescriptorBufferInfo reservoirs_info = { frame_resources[i].sbo_reservoirs.handle, 0, VK_WHOLE_SIZE };
+        VkDescriptorBufferInfo prev_reservoirs_info = { prev_resource.sbo_reservoirs.handle, 0, VK_WHOLE_SIZE };
+
+        // the lights and the light tree are bound in resize_light_buffers
         descriptor_set_t set0(set_layouts[0]);
         bind_buffer(set0, 0, &ubo_camera_info);
-        bind_buffer(set0, 1, &ubo_light_info);
         bind_buffer(set0, 2, &ubo_model_info);
         bind_buffer(set0, 3, &sbo_material_info);
         bind_buffer(set0, 4, &sbo_meshes_info);
-        bind_buffer(set0, 5, &sbo_light_tree_info);
+        bind_buffer(set0, 9, &tile_cuts_info);
+        bind_buffer(set0, 10, &blue_noise_info);
+        bind_buffer(set0, 11, &reservoirs_info);
+        bind_buffer(set0, 12, &prev_reservoirs_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set0));
 
         // set 1
@@ -581,28 +1062,36 @@ void renderer_t::update_descriptors(scene_t& scene)
         bind_image(set2, 0, &storage_image_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set2));
 
-        // (morton encode)
-        create_buffer(context, MAX_LIGHTS * sizeof(encoded_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &frame_resources[i].sbo_encoded_lights);
-        create_buffer(context, sizeof(light_bounds_t), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &frame_resources[i].ubo_bounds);
-
-        VkDescriptorBufferInfo sbo_encoded_lights_info = { frame_resources[i].sbo_encoded_lights.handle, 0, VK_WHOLE_SIZE };
-        VkDescriptorBufferInfo ubo_bounds_info = { frame_resources[i].ubo_bounds.handle, 0, VK_WHOLE_SIZE };
+        // (light bounds and morton encode)
+        create_buffer(context, sizeof(light_bounds_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_light_bounds);
+        create_buffer(context, LIGHT_ANIMATION_GROUPS * sizeof(light_animation_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+                &frame_resources[i].sbo_light_animation);
+        VkDescriptorBufferInfo light_bounds_info = { frame_resources[i].sbo_light_bounds.handle, 0, VK_WHOLE_SIZE };
+        create_buffer(context, sizeof(light_dispatch_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 
+                &frame_resources[i].sbo_light_dispatch);
+        VkDescriptorBufferInfo light_animation_info = { frame_resources[i].sbo_light_animation.handle, 0, VK_WHOLE_SIZE };
+        VkDescriptorBufferInfo light_dispatch_info = { frame_resources[i].sbo_light_dispatch.handle, 0, VK_WHOLE_SIZE };
         descriptor_set_t set3(set_layouts[3]);
-        bind_buffer(set3, 0, &ubo_light_info);
-        bind_buffer(set3, 1, &sbo_encoded_lights_info);
-        bind_buffer(set3, 2, &ubo_bounds_info);
+        bind_buffer(set3, 2, &light_bounds_info);
+        bind_buffer(set3, 4, &light_animation_info);
+        bind_buffer(set3, 5, &light_dispatch_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set3));
 
         // (sorter)
         descriptor_set_t set4(set_layouts[4]);
-        bind_buffer(set4, 0, &sbo_encoded_lights_info);
+        bind_buffer(set4, 1, &light_dispatch_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set4));
 
         // (tree builder)
+        create_buffer(context, sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &frame_resources[i].sbo_traversal_result);
+        create_buffer(context, sizeof(tree_validation_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+                &frame_resources[i].sbo_tree_validation, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VkDescriptorBufferInfo traversal_result_info = { frame_resources[i].sbo_traversal_result.handle, 0, VK_WHOLE_SIZE };
+        VkDescriptorBufferInfo tree_validation_info = { frame_resources[i].sbo_tree_validation.handle, 0, VK_WHOLE_SIZE };
         descriptor_set_t set5(set_layouts[5]);
-        bind_buffer(set5, 0, &ubo_light_info);
-        bind_buffer(set5, 1, &sbo_encoded_lights_info);
-        bind_buffer(set5, 2, &sbo_light_tree_info);
+        bind_buffer(set5, 7, &traversal_result_info);
+        bind_buffer(set5, 10, &tree_validation_info);
+        bind_buffer(set5, 12, &light_dispatch_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set5));
 
         descriptor_set_t set6(set_layouts[2]); // same descriptor layout
@@ -610,33 +1099,87 @@ void renderer_t::update_descriptors(scene_t& scene)
         bind_image(set6, 0, &depth_attachment_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set6));
 
-        // buffer for bbox lines
-        create_buffer(context, MAX_LIGHTS * sizeof(v4) * 12 * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &frame_resources[i].vbo_lines);
+        // buffer for bbox lines (only up to the debug tree size)
+        create_buffer(context, MAX_DEBUG_LIGHTS * sizeof(v4) * 12 * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &frame_resources[i].vbo_lines);
         VkDescriptorBufferInfo line_vbo_info = { frame_resources[i].vbo_lines.handle, 0, VK_WHOLE_SIZE };
         descriptor_set_t set7(set_layouts[6]);
-        bind_buffer(set7, 0, &sbo_light_tree_info);
         bind_buffer(set7, 1, &line_vbo_info);
+        bind_buffer(set7, 3, &light_dispatch_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set7));
        
         // buffer for sample ray lines
         create_buffer(context, MAX_LIGHTS_SAMPLED * sizeof(v4) * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &frame_resources[i].vbo_ray_lines);
         VkDescriptorBufferInfo ray_lines_vbo_info = { frame_resources[i].vbo_ray_lines.handle, 0, VK_WHOLE_SIZE };
-        create_buffer(context, MAX_LIGHT_TREE_SIZE * sizeof(i32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &frame_resources[i].sbo_nodes_highlight);
-        VkDescriptorBufferInfo nodes_highlight_info = { frame_resources[i].sbo_nodes_highlight.handle, 0, VK_WHOLE_SIZE };
-        create_buffer(context, MAX_LIGHTS * sizeof(i32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &frame_resources[i].sbo_leaf_select);
-        VkDescriptorBufferInfo selected_leafs_info = { frame_resources[i].sbo_leaf_select.handle, 0, VK_WHOLE_SIZE };
         descriptor_set_t set8(set_layouts[7]);
         bind_buffer(set8, 0, &ray_lines_info_info);
         bind_buffer(set8, 1, &ray_lines_vbo_info);
-        bind_buffer(set8, 2, &nodes_highlight_info);
-        bind_buffer(set8, 3, &selected_leafs_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set8));
        
         // fragment shader for lines pipeline
         descriptor_set_t set9(set_layouts[8]);
-        bind_buffer(set9, 0, &nodes_highlight_info);
         frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set9));
 
+        // (radix sort) ping-pong between the encoded lights and a temporary buffer
+        descriptor_set_t set10(set_layouts[9]);
+        bind_buffer(set10, 3, &light_dispatch_info);
+        frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set10));
+
+        descriptor_set_t set11(set_layouts[9]);
+        bind_buffer(set11, 3, &light_dispatch_info);
+        frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set11));
+
+        // (tile light cuts) the light tree is bound in resize_light_buffers
+        VkDescriptorImageInfo normal_attachment_info = { color_sampler[i], color_attachment[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        descriptor_set_t set12(set_layouts[10]);
+        bind_buffer(set12, 0, &ubo_camera_info);
+        bind_image(set12, 1, &depth_attachment_info);
+        bind_image(set12, 2, &normal_attachment_info);
+        bind_buffer(set12, 3, &tile_cuts_info);
+        frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set12));
+
+        // (temporal accumulation)
+        VkDescriptorImageInfo motion_attachment_info = { color_sampler[i], motion_attachment[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        VkDescriptorImageInfo prev_history_color_info = { VK_NULL_HANDLE, prev_resource.history_color.view, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo prev_history_geometry_info = { VK_NULL_HANDLE, prev_resource.history_geometry.view, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo history_color_info = { VK_NULL_HANDLE, frame_resources[i].history_color.view, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo history_geometry_info = { VK_NULL_HANDLE, frame_resources[i].history_geometry.view, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo prev_history_moments_info = { VK_NULL_HANDLE, prev_resource.history_moments.view, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo history_moments_info = { VK_NULL_HANDLE, frame_resources[i].history_moments.view, VK_IMAGE_LAYOUT_GENERAL };
+        descriptor_set_t set13(set_layouts[11]);
+        bind_buffer(set13, 0, &ubo_camera_info);
+        bind_image(set13, 1, &depth_attachment_info);
+        bind_image(set13, 2, &normal_attachment_info);
+        bind_image(set13, 3, &motion_attachment_info);
+        bind_image(set13, 4, &storage_image_info);
+        bind_image(set13, 5, &prev_history_color_info);
+        bind_image(set13, 6, &prev_history_geometry_info);
+        bind_image(set13, 7, &history_color_info);
+        bind_image(set13, 8, &history_geometry_info);
+        bind_image(set13, 9, &prev_history_moments_info);
+        bind_image(set13, 10, &history_moments_info);
+        frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, set13));
+
+        // (svgf) set 14 filters svgf_filter[0] into svgf_filter[1], set 15 the other way around
+        VkDescriptorImageInfo albedo_attachment_info = { color_sampler[i], albedo_attachment[i].view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        for (u32 j = 0; j < 2; ++j)
+        {
+            VkDescriptorImageInfo filter_input_info = { VK_NULL_HANDLE, frame_resources[i].svgf_filter[j].view, VK_IMAGE_LAYOUT_GENERAL };
+            VkDescriptorImageInfo filter_output_info = { VK_NULL_HANDLE, frame_resources[i].svgf_filter[1 - j].view, VK_IMAGE_LAYOUT_GENERAL };
+            descriptor_set_t svgf_set(set_layouts[12]);
+            bind_buffer(svgf_set, 0, &ubo_camera_info);
+            bind_image(svgf_set, 1, &depth_attachment_info);
+            bind_image(svgf_set, 2, &normal_attachment_info);
+            bind_image(svgf_set, 3, &albedo_attachment_info);
+            bind_image(svgf_set, 4, &storage_image_info);
+            bind_image(svgf_set, 5, &history_color_info);
+            bind_image(svgf_set, 6, &history_moments_info);
+            bind_image(svgf_set, 7, &filter_input_info);
+            bind_image(svgf_set, 8, &filter_output_info);
+            frame_resources[i].descriptor_sets.push_back(build_descriptor_set(descriptor_allocator, svgf_set));
+        }
+
+        resize_light_buffers(frame_resources[i], MAX(next_pow2(light_count(scene)), static_cast<u32>(MIN_LIGHT_CAPACITY)));
+
         // create sync objects (todo: move this)
         VkSemaphoreCreateInfo semaphore_info = {};
         semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -646,6 +1189,7 @@ void renderer_t::update_descriptors(scene_t& scene)
         fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
         VK_CHECK( vkCreateSemaphore(context.device, &semaphore_info, nullptr, &frame_resources[i].rt_semaphore) );
         VK_CHECK( vkCreateSemaphore(context.device, &semaphore_info, nullptr, &frame_resources[i].prepass_semaphore) );
+        VK_CHECK( vkCreateSemaphore(context.device, &semaphore_info, nullptr, &frame_resources[i].build_semaphore) );
         VK_CHECK( vkCreateFence(context.device, &fence_info, nullptr, &frame_resources[i].rt_fence) );
 
         // todo: use transfer queue for this part
@@ -670,13 +1214,21 @@ void renderer_t::update_descriptors(scene_t& scene)
         barrier.subresourceRange.baseArrayLayer = 0;
         barrier.subresourceRange.layerCount = 1;
 
+        // the history and filter images are only used by the temporal accumulation and svgf
+        VkImageMemoryBarrier barriers[6] = { barrier, barrier, barrier, barrier, barrier, barrier };
+        barriers[1].image = frame_resources[i].history_color.handle;
+        barriers[2].image = frame_resources[i].history_geometry.handle;
+        barriers[3].image = frame_resources[i].history_moments.handle;
+        barriers[4].image = frame_resources[i].svgf_filter[0].handle;
+        barriers[5].image = frame_resources[i].svgf_filter[1].handle;
+
         vkCmdPipelineBarrier(cmd, 
                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                 0, 
                 0, nullptr,
                 0, nullptr,
-                1, &barrier);
+                6, barriers);
 
         VkCommandBufferAllocateInfo alloc{};
         alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -690,8 +1242,8 @@ void renderer_t::update_descriptors(scene_t& scene)
         VK_CHECK( vkAllocateCommandBuffers(context.device, &alloc, &frame_resources[i].cmd_dwn) );
     }
     end_upload(staging); // uploaded to transfer
-    end_and_submit_command_buffer(cmd, context.q_compute);
-    VK_CHECK(wait_for_queue(context.q_compute));
+    end_and_submit_command_buffer(cmd, context.q_graphics);
+    VK_CHECK(wait_for_queue(context.q_graphics));
     VK_CHECK(wait_for_queue(context.q_transfer));
     vkFreeCommandBuffers(context.device, context.frames[0].command_pool, 1, &cmd); 
 }
@@ -703,26 +1255,34 @@ renderer_t::~renderer_t()
     LOG_INFO("Descructor renderer");
     for (auto& f : frame_resources)
     {
-        destroy_buffer(context, f.ubo_light);
+        destroy_light_buffers(context, f);
         destroy_buffer(context, f.ubo_camera);
         destroy_buffer(context, f.ubo_model);
         destroy_buffer(context, f.sbo_material);
         destroy_buffer(context, f.sbo_meshes);
         destroy_buffer(context, f.ubo_scene);
-        destroy_buffer(context, f.ubo_bounds);
-        destroy_buffer(context, f.sbo_encoded_lights);
-        destroy_buffer(context, f.sbo_light_tree);
+        destroy_buffer(context, f.sbo_light_bounds);
+        destroy_buffer(context, f.sbo_light_animation);
+        destroy_buffer(context, f.sbo_light_dispatch);
+        destroy_buffer(context, f.sbo_traversal_result);
+        destroy_buffer(context, f.sbo_tree_validation);
         destroy_buffer(context, f.vbo_lines);
-        destroy_buffer(context, f.sbo_nodes_highlight);
-        destroy_buffer(context, f.sbo_leaf_select);
         destroy_buffer(context, f.vbo_ray_lines);
+        destroy_buffer(context, f.sbo_tile_cuts);
+        destroy_buffer(context, f.sbo_reservoirs);
 
         destroy_image(context, f.storage_image);
         vkDestroySampler(context.device, f.storage_image_sampler, nullptr);
+        destroy_image(context, f.history_color);
+        destroy_image(context, f.history_geometry);
+        destroy_image(context, f.history_moments);
+        destroy_image(context, f.svgf_filter[0]);
+        destroy_image(context, f.svgf_filter[1]);
 
         vkDestroyFence(context.device, f.rt_fence, nullptr);
         vkDestroySemaphore(context.device, f.rt_semaphore, nullptr);
         vkDestroySemaphore(context.device, f.prepass_semaphore, nullptr);
+        vkDestroySemaphore(context.device, f.build_semaphore, nullptr);
     }
 
     LOG_INFO("Destroy set layouts");
@@ -730,7 +1290,6 @@ renderer_t::~renderer_t()
     {
         destroy_set_layout(context.device, l);
     }
-    free(empty_buffer);
     
     destroy_descriptor_allocator(descriptor_allocator);
 
@@ -738,6 +1297,8 @@ renderer_t::~renderer_t()
     {
         destroy_image(context, color_attachment[i]);
         destroy_image(context, depth_attachment[i]);
+        destroy_image(context, motion_attachment[i]);
+        destroy_image(context, albedo_attachment[i]);
         vkDestroySampler(context.device, color_sampler[i], nullptr);
         vkDestroySampler(context.device, depth_sampler[i], nullptr);
         vkDestroyFramebuffer(context.device, prepass_framebuffer[i], nullptr);
@@ -747,22 +1308,45 @@ renderer_t::~renderer_t()
     vkDestroyRenderPass(context.device, bbox_render_pass, nullptr);
     vkDestroyRenderPass(context.device, prepass_render_pass, nullptr);
     destroy_buffer(context, ray_lines_info);
+    destroy_buffer(context, sbo_blue_noise);
 
     LOG_INFO("Destroy pipelines");
     destroy_pipeline(context, &prepass_pipeline);
     destroy_pipeline(context, &debug_pipeline);
     destroy_pipeline(context, &query_pipeline);
-    destroy_pipeline(context, &rtx_pipeline);
+    for (auto& variant : rtx_variants)
+    {
+        destroy_pipeline(context, &variant.second.pipeline);
+        destroy_shader_binding_table(context, variant.second.sbt);
+    }
     destroy_pipeline(context, &post_pipeline);
     destroy_pipeline(context, &points_pipeline);
     destroy_pipeline(context, &lines_pipeline);
+    destroy_pipeline(context, &light_animate_compute_pipeline);
+    destroy_pipeline(context, &light_dispatch_compute_pipeline);
+    destroy_pipeline(context, &light_bounds_compute_pipeline);
     destroy_pipeline(context, &morton_compute_pipeline);
     destroy_pipeline(context, &sort_compute_pipeline);
+    destroy_pipeline(context, &radix_histogram_pipeline);
+    destroy_pipeline(context, &radix_scan_pipeline);
+    destroy_pipeline(context, &radix_scan_add_pipeline);
+    destroy_pipeline(context, &radix_scatter_pipeline);
     destroy_pipeline(context, &tree_leafs_compute_pipeline);
     destroy_pipeline(context, &tree_compute_pipeline);
+    destroy_pipeline(context, &tree_fused_compute_pipeline);
+    destroy_pipeline(context, &lbvh_internal_compute_pipeline);
+    destroy_pipeline(context, &lbvh_bounds_compute_pipeline);
+    destroy_pipeline(context, &tree_cost_compute_pipeline);
+    destroy_pipeline(context, &tree_validate_compute_pipeline);
+    destroy_pipeline(context, &light_cut_tiles_compute_pipeline);
+    destroy_pipeline(context, &temporal_accumulation_compute_pipeline);
+    destroy_pipeline(context, &svgf_variance_compute_pipeline);
+    destroy_pipeline(context, &svgf_atrous_compute_pipeline);
+    destroy_pipeline(context, &tree_wide_compute_pipeline);
+    destroy_pipeline(context, &tree_quant_compute_pipeline);
+    destroy_pipeline(context, &traversal_compute_pipeline);
     destroy_pipeline(context, &bbox_lines_pso);
 
-    destroy_shader_binding_table(context, sbt);
     destroy_shader_binding_table(context, query_sbt);
 
     destroy_staging_buffer(staging);
@@ -770,6 +1354,40 @@ renderer_t::~renderer_t()
     destroy_context(context);
 }
 
+// light cut capacities of the ray tracing pipeline variants, the smallest one that fits the cut size is used
+static const u32 rtx_cut_capacities[] = { 1, 4, 16, MAX_CUT_SIZE };
+
+rtx_variant_t& renderer_t::get_rtx_variant(const render_state_t& state, bool debug_view)
+{
+    u32 max_cut_size = MAX_CUT_SIZE;
+    for (u32 capacity : rtx_cut_capacities)
+    {
+        if (static_cast<u32>(state.cut_size) <= capacity)
+        {
+            max_cut_size = capacity;
+            break;
+        }
+    }
+    u32 num_samples = static_cast<u32>(MAX(state.num_samples, 1));
+    u32 key = max_cut_size | (num_samples << 8) | (static_cast<u32>(debug_view) << 24);
+
+    auto it = rtx_variants.find(key);
+    if (it != rtx_variants.end())
+    {
+        return it->second;
+    }
+
+    // the pipeline is built the first time the variant is used (stalls that frame)
+    LOG_INFO("Build ray tracing pipeline variant (cut size <= %d, %d samples, debug %d)", max_cut_size, num_samples, debug_view);
+    set_specialization_constant(rtx_description, RT_CONSTANT_MAX_CUT_SIZE, max_cut_size);
+    set_specialization_constant(rtx_description, RT_CONSTANT_NUM_SAMPLES, num_samples);
+    set_specialization_constant(rtx_description, RT_CONSTANT_DEBUG, static_cast<u32>(debug_view));
+    rtx_variant_t& variant = rtx_variants[key];
+    build_raytracing_pipeline(context, rtx_description, &variant.pipeline);
+    build_shader_binding_table(context, rtx_description, variant.pipeline, variant.sbt);
+    return variant;
+}
+
 void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& state)
 {
     static bool mat_uploaded[2] = {false, false};
@@ -780,11 +1398,70 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
     prepare_frame(context, &frame_index, &frame);
     VK_CHECK( vkWaitForFences(context.device, 1, &frame_resources[frame_index].rt_fence, VK_TRUE, ONE_SECOND_IN_NANOSECONDS) );
     vkResetFences(context.device, 1, &frame_resources[frame_index].rt_fence);
+    if (read_timers(profiler, frame_index))
+    {
+        state.timings = profiler.results;
+        state.gpu_time[PROFILER_QUEUE_GRAPHICS] = get_results(profiler, PROFILER_QUEUE_GRAPHICS);
+        state.gpu_time[PROFILER_QUEUE_COMPUTE] = get_results(profiler, PROFILER_QUEUE_COMPUTE);
+    }
+
+    // cost of the tree that was built the last time this frame was used
+    frame_resource_t& resource = frame_resources[frame_index];
+    if (resource.tree_cost_written)
+    {
+        // root area, number of partial sums (the workgroups of the dispatch) and the partial sums
+        f32* p_cost;
+        context.allocator.map_memory(resource.sbo_light_tree_cost.allocation, (void**)&p_cost);
+        u32 num_partial_areas = reinterpret_cast<u32*>(p_cost)[1];
+        f32 area = 0.0f;
+        for (u32 i = 0; i < num_partial_areas; i++)
+        {
+            area += p_cost[2 + i];
+        }
+        resource.tree_cost = p_cost[0] > 0.0f ? area / p_cost[0] : 0.0f;
+        context.allocator.unmap_memory(resource.sbo_light_tree_cost.allocation);
+
+        if (resource.tree_rebuilt)
+        {
+            resource.tree_rebuild_cost = resource.tree_cost;
+        }
+        resource.tree_cost_written = false;
+        state.tree_cost = resource.tree_cost;
+        state.tree_rebuild_cost = resource.tree_rebuild_cost;
+    }
+
+    // errors in the tree that was built the last time this frame was used
+    if (resource.tree_validated)
+    {
+        tree_validation_t* p_result;
+        context.allocator.map_memory(resource.sbo_tree_validation.allocation, (void**)&p_result);
+        state.tree_validation = *p_result;
+        context.allocator.unmap_memory(resource.sbo_tree_validation.allocation);
+        resource.tree_validated = false;
+
+        const auto& v = state.tree_validation;
+        bool valid = v.bounds_errors == 0 && v.intensity_errors == 0 && v.id_errors == 0;
+        if (!valid && state.tree_validation_ok)
+        {
+            LOG_ERROR("Invalid light tree: %u bounds, %u intensity and %u id errors (first node %u)", 
+                    v.bounds_errors, v.intensity_errors, v.id_errors, v.first_error_node);
+        }
+        state.invalid_trees += valid ? 0 : 1;
+        state.tree_validation_ok = valid;
+    }
+
+    // grow the light buffers of this frame, both its fences were waited on so they are not in use
+    u32 light_capacity = MAX(next_pow2(light_count(scene)), static_cast<u32>(MIN_LIGHT_CAPACITY));
+    if (light_capacity > resource.light_capacity)
+    {
+        resize_light_buffers(resource, light_capacity);
+    }
     get_next_swapchain_image(context, frame);
 
     {
-        auto pool = frame->command_pool;
-        VK_CHECK( vkResetCommandPool(context.device, pool, 0) );
+        // the ray tracing (rt_fence) waited on the build so both pools are no longer in use
+        VK_CHECK( vkResetCommandPool(context.device, frame->command_pool, 0) );
+        VK_CHECK( vkResetCommandPool(context.device, frame->compute_command_pool, 0) );
 
         /*
          * Upload all the neceserray data to GPU
@@ -809,32 +1486,65 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             mat_uploaded[frame_index] = true;
         }
 
-        // lights
-        copy_to_buffer(staging, frame_resources[frame_index].ubo_light, sizeof(light_t) * scene.lights.size(), (void*)scene.lights.data(), 0);
-
-        /*
-         * Calculate the bounding box of the entire cluster of light in the scene
-         */
-        v3 bbox_min = vec3(FLT_MAX);
-        v3 bbox_max = vec3(FLT_MIN);
-        for (auto const& light : scene.lights)
+        // lights (only if they changed since this frame was last used), the static lights are stored 
+        // first so the dynamic lights move in the buffer when the static lights change. light buffers larger 
+        // than the staging buffer are uploaded in chunks
+        u32 num_static_lights = static_cast<u32>(scene.static_lights.size());
+        bool lights_uploaded = false; // the light build has to wait for the upload
+        bool static_lights_changed = resource.static_lights_version != scene.static_lights_version;
+        bool lights_changed = resource.lights_version != scene.lights_version || static_lights_changed;
+        resource.static_lights_version = scene.static_lights_version;
+        resource.lights_version = scene.lights_version;
+        if (static_lights_changed)
         {
-            bbox_min = min(bbox_min, light.pos.xyz);
-            bbox_max = max(bbox_max, light.pos.xyz);
+            // the tree is built when the static lights are committed (main.cpp)
+            if (num_static_lights > 0)
+            {
+                const auto& static_tree = scene.static_tree;
+                copy_to_buffer(staging, resource.ubo_light, sizeof(light_t) * num_static_lights, (void*)scene.static_lights.data(), 0);
+                copy_to_buffer(staging, resource.sbo_light_tree_static, sizeof(node_t) * static_tree.size(), (void*)static_tree.data(), 0);
+                lights_uploaded = true;
+            }
+            resource.tree_num_lights = -1; // the sorted order of the previous build has the old light ids
+        }
+        if (lights_changed && !scene.lights.empty())
+        {
+            // the bounds of the lights are reduced on the gpu before the morton encoding
+            copy_to_buffer(staging, resource.ubo_light, sizeof(light_t) * scene.lights.size(), (void*)scene.lights.data(), 
+                    sizeof(light_t) * num_static_lights);
+            lights_uploaded = true;
         }
-        light_bounds_t bounds;
-        bounds.origin = bbox_min;
-        bounds.dims = bbox_max - bbox_min;
-        copy_to_buffer(staging, frame_resources[frame_index].ubo_bounds, sizeof(light_bounds_t), (void*)&bounds, 0);
+        // the gpu lights never leave the gpu, they are written after the static lights by light_animate.comp 
+        // and only the animation groups are uploaded when they change
+        const auto& gpu_lights = scene.gpu_lights;
+        bool animate_lights = gpu_lights.count > 0 && (lights_changed || gpu_lights_animated(scene));
+        if (gpu_lights.count > 0 && resource.light_animation_version != gpu_lights.groups_version)
+        {
+            copy_to_buffer(staging, resource.sbo_light_animation, sizeof(gpu_lights.groups), (void*)gpu_lights.groups, 0);
+            resource.light_animation_version = gpu_lights.groups_version;
+            animate_lights = true;
+            lights_uploaded = true;
+        }
+        lights_changed = lights_changed || animate_lights;
 
-        // upload camera data
+        // upload camera data (the first frame has no previous camera)
+        m4x4 view_proj = camera.m_proj * camera.m_view;
+        if (frame_number == 0)
+        {
+            prev_view_proj = view_proj;
+            prev_camera_pos = camera.position;
+        }
         camera_ubo_t camera_data;
         camera_data.pos.xyz = camera.position; 
         camera_data.view = camera.m_view;
         camera_data.proj = camera.m_proj;
         camera_data.inv_view = inverse(camera.m_view);
         camera_data.inv_proj = inverse(camera.m_proj);
+        camera_data.prev_view_proj = prev_view_proj;
+        camera_data.prev_pos.xyz = prev_camera_pos;
         copy_to_buffer(staging, frame_resources[frame_index].ubo_camera, sizeof(camera_ubo_t), (void*)&camera_data, 0);
+        prev_view_proj = view_proj;
+        prev_camera_pos = camera.position;
 
         // upload model data
         auto& meshes = scene.meshes;
@@ -854,32 +1564,25 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
         }
         copy_to_buffer(staging, frame_resources[frame_index].ubo_model, model_data.size() * sizeof(model_t), (void*)model_data.data());
 
-        // clear the ray lines buffer
-        {
-            if (!empty_buffer)
-            {
-                empty_buffer = calloc(MAX_LIGHTS * 24, sizeof(v4));
-            }
-            copy_to_buffer(staging, frame_resources[frame_index].vbo_ray_lines, MAX_LIGHTS_SAMPLED * 2 * sizeof(v4), empty_buffer, 0);
-            copy_to_buffer(staging, frame_resources[frame_index].vbo_lines, MAX_LIGHTS * 24 * sizeof(v4), empty_buffer, 0);
-            copy_to_buffer(staging, frame_resources[frame_index].sbo_nodes_highlight, MAX_LIGHT_TREE_SIZE * sizeof(i32), empty_buffer, 0);
-            copy_to_buffer(staging, frame_resources[frame_index].sbo_leaf_select, MAX_LIGHTS * sizeof(i32), empty_buffer, 0);
-        }
-
         VkSemaphore upload_complete;
         end_upload(staging, &upload_complete);
    
         /*
-         * Prepass for albedo and depth buffer.
-         * The depth buffer will later be used for combining the result of the ray tracing pipeline and debuggin lines
+         * Prepass for the world normals and depth buffer.
+         * The depth buffer will later be used for combining the result of the ray tracing pipeline and debuggin lines,
+         * both are used for the tile light cuts
+         * (runs on the graphics queue while the light tree is built on the compute queue)
          */
         { 
             auto cmd = frame_resources[frame_index].cmd_prepass;
             VK_CHECK( begin_command_buffer(cmd) );
-            VkClearValue clear[2] = {};
+            begin_timer(profiler, cmd, frame_index, PROFILER_QUEUE_GRAPHICS);
+            VkClearValue clear[4] = {};
             // attachment order :/
             clear[1].color = {0, 0, 0, 0}; 
             clear[0].depthStencil = {1, 0};
+            clear[2].color = {0, 0, 0, 0}; // no motion where nothing is rendered
+            clear[3].color = {0, 0, 0, 0};
 
             VkRenderPassBeginInfo begin_info{};
             begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -887,7 +1590,7 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             begin_info.renderPass = prepass_render_pass;
             begin_info.framebuffer = prepass_framebuffer[frame_index];
             begin_info.renderArea = { {0,0}, context.swapchain.extent };
-            begin_info.clearValueCount = 2;
+            begin_info.clearValueCount = 4;
             begin_info.pClearValues = clear;
             vkCmdBeginRenderPass(cmd, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, prepass_pipeline.handle);
@@ -906,6 +1609,7 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                 first_instance_id += batch.instance_count;
             }
             vkCmdEndRenderPass(cmd);
+            write_timestamp(profiler, cmd, frame_index, "prepass");
             VK_CHECK( vkEndCommandBuffer(cmd) );
             VkSubmitInfo submit_info = {};
             submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -919,22 +1623,210 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             VK_CHECK( vkQueueSubmit(context.q_graphics, 1, &submit_info, nullptr) );
         }
 
-        VkCommandBuffer cmd = frame->command_buffer;
+        /*
+         * Light tree build on the compute queue, the ray tracing waits on build_semaphore
+         */
+        VkCommandBuffer cmd = frame->compute_command_buffer;
         VK_CHECK( begin_command_buffer(cmd) );
-        begin_timer(profiler, cmd);
-        i32 num_lights = static_cast<i32>(scene.lights.size());
-        i32 num_leaf_nodes = num_lights; // will be modified at bitonic sort
+        begin_timer(profiler, cmd, frame_index, PROFILER_QUEUE_COMPUTE);
+        // with the complete tree only the dynamic lights are built every frame (two-level tree), 
+        // the other tree types are built over all lights
+        bool two_level = state.tree_type == LIGHT_TREE_TYPE_COMPLETE && num_static_lights > 0;
+        u32 first_light = two_level ? num_static_lights : 0;
+        i32 num_scene_lights = static_cast<i32>(light_count(scene));
+        i32 num_lights = num_scene_lights - static_cast<i32>(first_light);
+        i32 num_sort_nodes = next_pow2(num_lights); // add dummy nodes to get to power of 2
+        
+        // the lbvh has no dummy nodes, both trees have 2n - 1 nodes for n leaf nodes
+        bool is_lbvh = state.tree_type == LIGHT_TREE_TYPE_LBVH;
+        bool is_wide = state.tree_type == LIGHT_TREE_TYPE_WIDE; // complete tree + 4-wide tree
+        bool is_quant = state.tree_type == LIGHT_TREE_TYPE_QUANTIZED; // complete tree + quantized copy
+        i32 num_leaf_nodes = is_lbvh ? num_lights : num_sort_nodes;
+        i32 num_nodes = MAX(2 * num_leaf_nodes - 1, 0); // no nodes if all lights are static
+        i32 num_inner_nodes = MAX(num_leaf_nodes - 1, 0);
+        i32 first_inner_node = is_lbvh ? 0 : num_leaf_nodes;
+        i32 num_static_nodes = two_level ? static_cast<i32>(scene.static_tree.size()) : 0;
+        state.num_nodes = num_nodes;
+        state.num_leaf_nodes = num_leaf_nodes;
+        state.two_level_tree = two_level;
+
+        // the bbox lines and the read back for the debug view are limited in size
+        bool debug_tree = num_leaf_nodes > 0 && num_leaf_nodes <= MAX_DEBUG_LIGHTS;
+        bool render_bboxes = state.render_bboxes && debug_tree;
+
+        // clear the debug buffers (written while ray tracing)
+        {
+            vkCmdFillBuffer(cmd, frame_resources[frame_index].vbo_ray_lines.handle, 0, MAX_LIGHTS_SAMPLED * 2 * sizeof(v4), 0);
+            vkCmdFillBuffer(cmd, frame_resources[frame_index].sbo_nodes_highlight.handle, 0, MAX(num_nodes, 1) * sizeof(i32), 0);
+            vkCmdFillBuffer(cmd, frame_resources[frame_index].sbo_leaf_select.handle, 0, MAX(num_scene_lights, 1) * sizeof(i32), 0);
+            if (render_bboxes)
+            {
+                vkCmdFillBuffer(cmd, frame_resources[frame_index].vbo_lines.handle, 0, MAX(num_inner_nodes, 1) * 24 * sizeof(v4), 0);
+            }
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        // the stages of the build read the number of lights and nodes from sbo_light_dispatch and are dispatched 
+        // with the arguments written here, only the number of lights is written by the host. it is written every 
+        // frame so the passes that run without a build (bboxes, traversal) see the sizes of the current tree
+        VkBuffer dispatch_buffer = frame_resources[frame_index].sbo_light_dispatch.handle;
+        auto dispatch_offset = [](u32 stage) -> VkDeviceSize
+        {
+            return offsetof(light_dispatch_t, dispatch) + stage * sizeof(dispatch_indirect_t);
+        };
+        auto level_dispatch_offset = [](u32 level) -> VkDeviceSize
+        {
+            return offsetof(light_dispatch_t, levels) + level * sizeof(dispatch_indirect_t);
+        };
+        auto fused_dispatch_offset = [](u32 pass) -> VkDeviceSize
+        {
+            return offsetof(light_dispatch_t, fused) + pass * sizeof(dispatch_indirect_t);
+        };
+        auto radix_scan_dispatch_offset = [](u32 level) -> VkDeviceSize
+        {
+            return offsetof(light_dispatch_t, radix_scan) + level * sizeof(dispatch_indirect_t);
+        };
+        auto radix_scan_add_dispatch_offset = [](u32 level) -> VkDeviceSize
+        {
+            return offsetof(light_dispatch_t, radix_scan_add) + level * sizeof(dispatch_indirect_t);
+        };
+        {
+            CHECKPOINT(cmd, "[PRE] LIGHT DISPATCH");
+            u32 dispatch_lights[2] = { static_cast<u32>(num_lights), gpu_lights.count }; // num_lights, num_gpu_lights
+            vkCmdUpdateBuffer(cmd, dispatch_buffer, offsetof(light_dispatch_t, num_lights), sizeof(dispatch_lights), dispatch_lights);
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_dispatch_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_dispatch_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[3], 0, nullptr);
+            u32 tree_type = static_cast<u32>(state.tree_type);
+            vkCmdPushConstants(cmd, light_dispatch_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &tree_type);
+            vkCmdDispatch(cmd, 1, 1, 1);
+
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+            CHECKPOINT(cmd, "[POST] LIGHT DISPATCH");
+        }
+
+        // the passes over the levels of the tree and the bitonic sort steps are recorded for the capacity of 
+        // the light buffers, the ones past the size of the tree are empty
+        u32 max_height = static_cast<u32>(log2(resource.light_capacity));
+
+        // generate the gpu lights at their positions of this frame
+        if (animate_lights)
+        {
+            CHECKPOINT(cmd, "[PRE] LIGHT ANIMATION");
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_animate_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_animate_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[3], 0, nullptr);
+            struct
+            {
+                v3  offset;
+                f32 time;
+                u32 first_light;
+                u32 seed;
+                f32 distance;
+                f32 cone_angle;
+            } constants;
+            constants.offset = gpu_lights.offset;
+            constants.time = static_cast<f32>(state.time);
+            constants.first_light = num_static_lights;
+            constants.seed = gpu_lights.seed;
+            constants.distance = gpu_lights.distance;
+            constants.cone_angle = gpu_lights.cone_angle;
+            vkCmdPushConstants(cmd, light_animate_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_ANIMATION));
+
+            // read by the tree build and while ray tracing
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+            CHECKPOINT(cmd, "[POST] LIGHT ANIMATION");
+            write_timestamp(profiler, cmd, frame_index, "light animation");
+        }
+
+        // the tree in this frame's buffers is still up to date if the lights did not change
+        bool tree_changed = resource.tree_type != state.tree_type || resource.morton_key_mode != state.morton_key_mode;
+        bool build_tree = num_lights > 0 && (lights_changed || tree_changed || state.always_rebuild_tree);
+        state.tree_unchanged = !build_tree;
+
+        // if only the positions of the lights changed the sorted order of the previous build is reused
+        // and only the bounds are updated, until the tree is too expensive compared to a fresh build
+        bool refit = build_tree 
+            && state.tree_update_mode == TREE_UPDATE_REFIT 
+            && resource.tree_num_lights == num_lights 
+            && !tree_changed
+            && resource.tree_cost <= state.refit_threshold * resource.tree_rebuild_cost;
+        bool sort_lights = build_tree && !refit;
+        if (build_tree)
+        {
+            resource.tree_num_lights = state.tree_update_mode == TREE_UPDATE_REFIT ? num_lights : -1;
+            resource.tree_type = state.tree_type;
+            resource.morton_key_mode = state.morton_key_mode;
+            resource.tree_rebuilt = !refit;
+        }
+        state.tree_refitted = refit;
+
+        // bounds of all lights (used to normalize the positions for the morton encoding)
+        if (ENABLE_MORTON_ENCODE && sort_lights)
+        {
+            CHECKPOINT(cmd, "[PRE] LIGHT BOUNDS");
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_bounds_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_bounds_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[3], 0, nullptr);
+            struct
+            {
+                u32 final_pass;
+                u32 first_light;
+            } constants;
+            constants.final_pass = 0;
+            constants.first_light = first_light;
+            vkCmdPushConstants(cmd, light_bounds_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_BOUNDS));
+            compute_barrier(cmd);
+
+            constants.final_pass = 1;
+            vkCmdPushConstants(cmd, light_bounds_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(cmd, 1, 1, 1);
+            compute_barrier(cmd);
+            CHECKPOINT(cmd, "[POST] LIGHT BOUNDS");
+            write_timestamp(profiler, cmd, frame_index, "light bounds");
+        }
 
         // morton encoding
-        if (ENABLE_MORTON_ENCODE) 
+        if (ENABLE_MORTON_ENCODE && sort_lights) 
         {
             CHECKPOINT(cmd, "[PRE] MORTON ENCODING");
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, morton_compute_pipeline.handle);
             vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, morton_compute_pipeline.layout, 0, 
                     1, &frame_resources[frame_index].descriptor_sets[3], 0, nullptr);
-            vkCmdPushConstants(cmd, morton_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(i32), &num_lights);
-            u32 threads = MAX(static_cast<u32>(num_lights)/512, 1);
-            vkCmdDispatch(cmd, threads, 1, 1);
+            struct
+            {
+                u32 first_light;
+                u32 key_mode;
+            } constants;
+            constants.first_light = first_light;
+            constants.key_mode = static_cast<u32>(state.morton_key_mode);
+            vkCmdPushConstants(cmd, morton_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_SORT_NODES)); // also writes the dummy nodes
 
             // memory barrier to wait for finish morton encoding
             VkMemoryBarrier barrier = {};
@@ -944,38 +1836,32 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
             CHECKPOINT(cmd, "[POST] MORTON ENCODING");
+            write_timestamp(profiler, cmd, frame_index, "morton encoding");
         }
 
         // bitonic sort lights
-        if (ENABLE_SORT_LIGHTS) 
+        if (ENABLE_SORT_LIGHTS && sort_lights && state.sort_mode == SORT_MODE_BITONIC) 
         {
             CHECKPOINT(cmd, "[PRE] BITONIC SORT");
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, sort_compute_pipeline.handle);
             vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, sort_compute_pipeline.layout, 0, 
                     1, &frame_resources[frame_index].descriptor_sets[4], 0, nullptr);
 
-            // add dummy nodes to get to power of 2
-            num_leaf_nodes = next_pow2(num_lights);
             struct 
             {
-                int j;
-                int k;
-                int num_lights;
-                int total_nodes;
+                u32 j;
+                u32 k;
             } constants;
     
-            u32 threads = MAX(num_leaf_nodes/512, 1);
-            constants.num_lights  = num_lights;
-            constants.total_nodes = num_leaf_nodes;
-            for (int k = 2; k <= num_leaf_nodes; k <<= 1) 
+            // the steps with k > num_sort_nodes return right away
+            for (u32 k = 2; k <= resource.light_capacity; k <<= 1) 
             {
-                for (int j = k >> 1; j > 0; j >>= 1)
+                for (u32 j = k >> 1; j > 0; j >>= 1)
                 {
                     constants.j = j;
                     constants.k = k;
-                    //LOG_INFO("k = %d, j = %d, threads = %d", k, j, threads);
                     vkCmdPushConstants(cmd, sort_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
-                    vkCmdDispatch(cmd, threads, 1, 1);
+                    vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_SORT_NODES));
 
                     // wait for prev to finish
                     VkMemoryBarrier barrier = {};
@@ -987,19 +1873,68 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                 }
             }
             CHECKPOINT(cmd, "[POST] BITONIC SORT");
+            write_timestamp(profiler, cmd, frame_index, "sort (bitonic)");
+        }
+
+        // radix sort lights (only the lights, dummy nodes are already at the back)
+        // histogram, scan (2 * levels - 1 dispatches) and scatter per pass, the result ends up in the encoded lights 
+        // buffer (even number of passes). the scan levels are recorded for the capacity, unused levels are empty
+        if (ENABLE_SORT_LIGHTS && sort_lights && state.sort_mode == SORT_MODE_RADIX)
+        {
+            CHECKPOINT(cmd, "[PRE] RADIX SORT");
+            struct
+            {
+                u32 shift;
+            } constants;
+            u32 scan_levels = radix_scan_levels(resource.light_capacity);
+
+            for (u32 pass = 0; pass < RADIX_SORT_PASSES; pass++)
+            {
+                constants.shift = pass * RADIX_SORT_BITS;
+                VkDescriptorSet set = frame_resources[frame_index].descriptor_sets[10 + (pass & 1)];
+
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_histogram_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_histogram_pipeline.layout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(cmd, radix_histogram_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_RADIX));
+                compute_barrier(cmd);
+
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scan_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scan_pipeline.layout, 0, 1, &set, 0, nullptr);
+                for (u32 level = 0; level < scan_levels; level++)
+                {
+                    vkCmdPushConstants(cmd, radix_scan_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &level);
+                    vkCmdDispatchIndirect(cmd, dispatch_buffer, radix_scan_dispatch_offset(level));
+                    compute_barrier(cmd);
+                }
+
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scan_add_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scan_add_pipeline.layout, 0, 1, &set, 0, nullptr);
+                for (u32 level = scan_levels - 1; level > 0; level--)
+                {
+                    vkCmdPushConstants(cmd, radix_scan_add_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &level);
+                    vkCmdDispatchIndirect(cmd, dispatch_buffer, radix_scan_add_dispatch_offset(level));
+                    compute_barrier(cmd);
+                }
+
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scatter_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, radix_scatter_pipeline.layout, 0, 1, &set, 0, nullptr);
+                vkCmdPushConstants(cmd, radix_scatter_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_RADIX));
+                compute_barrier(cmd);
+            }
+            CHECKPOINT(cmd, "[POST] RADIX SORT");
+            write_timestamp(profiler, cmd, frame_index, "sort (radix)");
         }
 
         // build light tree
-        if (ENABLE_LIGHT_TREE) 
+        if (ENABLE_LIGHT_TREE && build_tree && !is_lbvh && state.tree_build_mode == TREE_BUILD_PER_LEVEL) 
         {
             CHECKPOINT(cmd, "LIGHT TREE LEAF NODES");
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_leafs_compute_pipeline.handle);
             vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_leafs_compute_pipeline.layout, 0, 
                     1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
-            u32 leaf_nodes = static_cast<u32>(num_leaf_nodes);
-            vkCmdPushConstants(cmd, tree_leafs_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &leaf_nodes);
-            u32 threads = MAX(1, leaf_nodes/512);
-            vkCmdDispatch(cmd, threads, 1, 1);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_SORT_NODES));
 
             CHECKPOINT(cmd, "[PRE] LIGHT TREE BUILD");
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_compute_pipeline.handle);
@@ -1010,30 +1945,11 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             // each level waits for previous level to be processed and every node in a dispatch is computed in parrallel
             // this is better than creating all levels at once and merging from the leaf nodes directly because of cache 
             //  (nodes at the top are at the end of the array while leaf nodes are at the start)
-            u32 h = static_cast<u32>(log2(num_leaf_nodes));
-            u32 src_lvl = 0;
-            for (u32 dst_lvl = 1; dst_lvl <= h; dst_lvl++)
+            // level 0 -> 9 can be grouped together because L1 is 48kb (NVIDIA 1060 6GB)
+            // 0 -> 9 = 2^10 - 1 = 1023 < 1536 nodes (48kb/32b = 1536), see TREE_BUILD_FUSED
+            // the nodes of a level follow from the height of the tree in the dispatch buffer
+            for (u32 dst_lvl = 1; dst_lvl <= max_height; dst_lvl++)
             {
-                struct 
-                {
-                    u32 height;        // height of the tree (actually corresponds to 2^h = leaf nodes)
-                    u32 total_nodes;   // total nodes being processed in the current dispatch
-                    u32 start_id;      // used to calculate id and the level of a node being processed (root = 0)
-                    u32 src_level;     // the level from which to create nodes from (merge nodes together)
-                    u32 start_src_id;  // the start id for the src level nodes (used to access them in the array)
-                } constants;
-
-                // todo: could group level 0 -> 9 together because L1 is 48kb (NVIDIA 1060 6GB)
-                // 0 -> 9 = 2^10 - 1 = 1023 < 1536 nodes (48kb/32b = 1536)
-    
-                constants.height       = h;
-                constants.total_nodes  = (1 << (h - src_lvl)) - (1 << (h - dst_lvl));
-                constants.start_src_id = (1 << (h + 1)) - (1 << (h - src_lvl + 1));
-                constants.start_id     = ((1 << (h - src_lvl + 1)) - 1) - (1 << (h - src_lvl)) - constants.total_nodes;
-                constants.src_level    = h - src_lvl;
-                //LOG_INFO("level %d to %d, nodes = %d, start_srd_id=%d, src_level=%d", h - src_lvl, h - dst_lvl, 
-                //            constants.total_nodes, constants.start_src_id, constants.src_level);
-                
                 // wait for previous level to finish
                 VkMemoryBarrier barrier = {};
                 barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
@@ -1043,11 +1959,8 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
                         0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-                vkCmdPushConstants(cmd, tree_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
-                u32 groups = MAX(constants.total_nodes / 512, 1);
-                vkCmdDispatch(cmd, groups, 1, 1);
-                
-                src_lvl = dst_lvl;
+                vkCmdPushConstants(cmd, tree_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &dst_lvl);
+                vkCmdDispatchIndirect(cmd, dispatch_buffer, level_dispatch_offset(dst_lvl - 1));
             }
 
             VkMemoryBarrier barrier = {};
@@ -1058,24 +1971,215 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                     VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
                     0, 1, &barrier, 0, nullptr, 0, nullptr);
             CHECKPOINT(cmd, "[POST] LIGHT TREE BUILD");
+            write_timestamp(profiler, cmd, frame_index, refit ? "light tree (refit)" : "light tree");
+        }
+
+        // build light tree, the leaf nodes are created in the first dispatch and every dispatch 
+        // reduces up to 10 levels in shared memory (2 dispatches for 2^17 lights)
+        if (ENABLE_LIGHT_TREE && build_tree && !is_lbvh && state.tree_build_mode == TREE_BUILD_FUSED)
+        {
+            CHECKPOINT(cmd, "[PRE] LIGHT TREE BUILD (FUSED)");
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_fused_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_fused_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+
+            // the first pass creates the leaf nodes, the passes above the root are empty
+            u32 num_passes = MAX((max_height + LIGHT_TREE_FUSED_LEVELS - 1) / LIGHT_TREE_FUSED_LEVELS, 1u);
+            for (u32 pass = 0; pass < num_passes; pass++)
+            {
+                vkCmdPushConstants(cmd, tree_fused_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(u32), &pass);
+                // one workgroup per subtree of the levels merged in this pass
+                vkCmdDispatchIndirect(cmd, dispatch_buffer, fused_dispatch_offset(pass));
+
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                        0, 1, &barrier, 0, nullptr, 0, nullptr);
+            }
+            CHECKPOINT(cmd, "[POST] LIGHT TREE BUILD (FUSED)");
+            write_timestamp(profiler, cmd, frame_index, refit ? "light tree (refit)" : "light tree");
+        }
+
+        // build lbvh from the sorted lights: inner nodes (topology) and then the bounds bottom up
+        if (ENABLE_LIGHT_TREE && build_tree && is_lbvh)
+        {
+            CHECKPOINT(cmd, "[PRE] LBVH BUILD");
+            if (!refit)
+            {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, lbvh_internal_compute_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, lbvh_internal_compute_pipeline.layout, 0, 
+                        1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+                vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_INNER_NODES));
+                compute_barrier(cmd);
+            }
+            else
+            {
+                // topology (inner node ids and parents) is kept, only the visit flags are reset
+                vkCmdFillBuffer(cmd, frame_resources[frame_index].sbo_light_tree_flags.handle, 0, VK_WHOLE_SIZE, 0);
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            }
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, lbvh_bounds_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, lbvh_bounds_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_TREE_LEAFS));
+
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+            CHECKPOINT(cmd, "[POST] LBVH BUILD");
+            write_timestamp(profiler, cmd, frame_index, refit ? "light tree (refit)" : "light tree");
+        }
+
+        // collapse the complete tree into the 4-wide tree that is traversed
+        if (ENABLE_LIGHT_TREE && build_tree && is_wide)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_wide_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_wide_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_WIDE_NODES)); // none for a single light
+
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+            write_timestamp(profiler, cmd, frame_index, "wide tree");
+        }
+
+        // quantize the complete tree, one thread per node
+        if (ENABLE_LIGHT_TREE && build_tree && is_quant)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_quant_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_quant_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_NODES));
+
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                    0, 1, &barrier, 0, nullptr, 0, nullptr);
+            write_timestamp(profiler, cmd, frame_index, "quantized tree");
+        }
+
+        // traverse the binary and the 4-wide or quantized tree from the root for the same random points
+        if (ENABLE_LIGHT_TREE && (is_wide || is_quant) && state.benchmark_traversal)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, traversal_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, traversal_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            struct
+            {
+                u32 tree_type;
+                u32 seed;
+            } constants;
+            constants.seed = static_cast<u32>(rand());
+
+            constants.tree_type = LIGHT_TREE_TYPE_COMPLETE;
+            vkCmdPushConstants(cmd, traversal_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_TRAVERSAL));
+            compute_barrier(cmd);
+            write_timestamp(profiler, cmd, frame_index, "traversal (binary)");
+
+            constants.tree_type = static_cast<u32>(state.tree_type);
+            vkCmdPushConstants(cmd, traversal_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_TRAVERSAL));
+            compute_barrier(cmd);
+            write_timestamp(profiler, cmd, frame_index, is_wide ? "traversal (4-wide)" : "traversal (quantized)");
+        }
+
+        // surface area of the inner nodes, read back the next time this frame is used
+        if (ENABLE_LIGHT_TREE && build_tree && state.tree_update_mode == TREE_UPDATE_REFIT)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_cost_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_cost_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            // also writes the number of partial sums for the read back
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_TREE_COST));
+            resource.tree_cost_written = true;
+
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            write_timestamp(profiler, cmd, frame_index, "tree cost");
         }
 
-        if (ENABLE_BBOX_DEBUG) 
+        // check the invariants of the tree of the dynamic lights, only the error counts are read back 
+        // (the next time this frame is used) so the frame is not stalled
+        if (ENABLE_VERIFY && ENABLE_LIGHT_TREE && build_tree)
+        {
+            vkCmdFillBuffer(cmd, resource.sbo_tree_validation_ids.handle, 0, VK_WHOLE_SIZE, 0);
+            vkCmdFillBuffer(cmd, resource.sbo_tree_validation.handle, 0, offsetof(tree_validation_t, first_error_node), 0);
+            vkCmdFillBuffer(cmd, resource.sbo_tree_validation.handle, offsetof(tree_validation_t, first_error_node), 
+                    sizeof(u32), 0xffffffff);
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_validate_compute_pipeline.handle);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, tree_validate_compute_pipeline.layout, 0, 
+                    1, &frame_resources[frame_index].descriptor_sets[5], 0, nullptr);
+            struct
+            {
+                u32 first_light;
+                u32 type;
+                u32 pass;
+            } constants;
+            constants.first_light = first_light;
+            constants.type = is_lbvh ? LIGHT_TREE_TYPE_LBVH : LIGHT_TREE_TYPE_COMPLETE;
+            constants.pass = 0;
+            vkCmdPushConstants(cmd, tree_validate_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_LEAF_NODES));
+            compute_barrier(cmd);
+
+            constants.pass = 1;
+            vkCmdPushConstants(cmd, tree_validate_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_LIGHTS));
+
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            resource.tree_validated = true;
+            write_timestamp(profiler, cmd, frame_index, "tree validation");
+        }
+
+        if (ENABLE_BBOX_DEBUG && render_bboxes) 
         {
             // write lines to vbo for debuging
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, bbox_lines_pso.handle);
             vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, bbox_lines_pso.layout, 0, 
                     1, &frame_resources[frame_index].descriptor_sets[7], 0, nullptr);
             struct {
-                i32 total_nodes;
-                i32 offset;
+                i32 max_depth;
             } constants;
-            i32 h = static_cast<i32>(log2(num_leaf_nodes));
-            constants.total_nodes = (1 << h) - 1;
-            constants.offset = num_leaf_nodes;
+            // levels of the lbvh are not stored contiguously so step mode is done here
+            constants.max_depth = is_lbvh && state.render_step_mode ? state.step : -1;
             vkCmdPushConstants(cmd, bbox_lines_pso.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
-            u32 threads = MAX(static_cast<u32>(constants.total_nodes)/512, 1);
-            vkCmdDispatch(cmd, threads, 1, 1);
+            vkCmdDispatchIndirect(cmd, dispatch_buffer, dispatch_offset(LIGHT_DISPATCH_INNER_NODES));
             VkMemoryBarrier barrier = {};
             barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
             barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -1083,11 +2187,70 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                     VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+            write_timestamp(profiler, cmd, frame_index, "bbox lines");
+        }
+
+        // only waits for the upload if it has new lights, else the build overlaps with the upload
+        {
+            VK_CHECK( vkEndCommandBuffer(cmd) );
+            VkPipelineStageFlags dst_wait_mask = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            VkSubmitInfo submit_info = {};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.pNext = nullptr;
+            submit_info.waitSemaphoreCount = lights_uploaded ? 1 : 0;
+            submit_info.pWaitSemaphores = &upload_complete;
+            submit_info.pWaitDstStageMask = &dst_wait_mask;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &cmd;
+            submit_info.signalSemaphoreCount = 1;
+            submit_info.pSignalSemaphores = &frame_resources[frame_index].build_semaphore;
+            VK_CHECK( vkQueueSubmit(context.q_compute, 1, &submit_info, nullptr) );
         }
 
+        /*
+         * Ray tracing on the graphics queue after the prepass
+         */
+        cmd = frame->command_buffer;
+        VK_CHECK( begin_command_buffer(cmd) );
+        begin_timer(profiler, cmd, frame_index, PROFILER_QUEUE_GRAPHICS);
+
         // render using light tree
         if (ENABLE_RTX)
         {
+            // one cut per tile from the prepass (the render pass makes the depth and normals visible to compute)
+            if (state.tile_light_cuts)
+            {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_cut_tiles_compute_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, light_cut_tiles_compute_pipeline.layout, 0, 
+                        1, &frame_resources[frame_index].descriptor_sets[12], 0, nullptr);
+                struct
+                {
+                    i32 num_nodes;
+                    i32 num_leaf_nodes;
+                    u32 cut_size;
+                    u32 tree_type;
+                    i32 num_static_nodes;
+                    i32 num_static_leaf_nodes;
+                } constants;
+                constants.num_nodes = num_nodes;
+                constants.num_leaf_nodes = num_leaf_nodes;
+                constants.cut_size = state.cut_size;
+                constants.tree_type = static_cast<u32>(state.tree_type);
+                constants.num_static_nodes = num_static_nodes;
+                constants.num_static_leaf_nodes = (num_static_nodes + 1) / 2;
+                vkCmdPushConstants(cmd, light_cut_tiles_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatch(cmd, group_count(context.swapchain.extent.width, LIGHT_CUT_TILE_SIZE), 
+                        group_count(context.swapchain.extent.height, LIGHT_CUT_TILE_SIZE), 1);
+
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+                write_timestamp(profiler, cmd, frame_index, "tile light cuts");
+            }
+
             CHECKPOINT(cmd, "[PRE] RAYTRACING");
             // ray query to get intersection point 
             if (state.render_sample_lines && is_key_pressed(*window, KEY_R))
@@ -1122,13 +2285,29 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
             }
 
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtx_pipeline.handle);
+            // the reservoirs of the previous frame were written by its ray tracing (previous submission on this
+            // queue) and only refer to the same lights if the number of lights did not change
+            bool restir_valid = reservoirs_valid && reservoir_num_lights == num_scene_lights;
+            if (state.restir)
+            {
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                        VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            }
+
+            // the debug buffers are only read by the bboxes, the sample lines and the read back of the tree
+            bool debug_view = render_bboxes || state.render_sample_lines || (state.read_back_tree && debug_tree);
+            rtx_variant_t& rtx = get_rtx_variant(state, debug_view);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtx.pipeline.handle);
             VkDescriptorSet sets[3] = { 
                 frame_resources[frame_index].descriptor_sets[0],
                 frame_resources[frame_index].descriptor_sets[1],
                 frame_resources[frame_index].descriptor_sets[8],
             };
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtx_pipeline.layout, 0, 3, sets, 0, nullptr);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtx.pipeline.layout, 0, 3, sets, 0, nullptr);
 
             struct 
             {
@@ -1138,55 +2317,144 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                 u32 num_samples;
                 u32 cut_size;
                 i32 is_ortho; // boolean
+                u32 tree_type;
+                i32 num_static_nodes;
+                i32 num_static_leaf_nodes;
+                i32 tile_cuts; // boolean
+                u32 sampler_mode;
+                u32 frame_number;
+                u32 restir_candidates; // 0 = off
+                i32 restir_reuse; // boolean
             } constants;
             
-            u32 h = static_cast<u32>(log2(num_leaf_nodes));
             timespec tp;
             clock_gettime(CLOCK_REALTIME, &tp);
-            constants.num_nodes = ((1 << (h + 1)) - 1);
+            constants.num_nodes = num_nodes;
             constants.num_leaf_nodes = num_leaf_nodes;
+            constants.tree_type = static_cast<u32>(state.tree_type);
+            constants.num_static_nodes = num_static_nodes;
+            constants.num_static_leaf_nodes = (num_static_nodes + 1) / 2;
             constants.num_samples = state.num_samples;
             constants.cut_size = state.cut_size;
             constants.time = (float)tp.tv_nsec;
             constants.is_ortho = static_cast<i32>(camera.is_ortho);
-            vkCmdPushConstants(cmd, rtx_pipeline.layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(constants), &constants);
-            vkCmdTraceRays(cmd, &sbt.rgen, &sbt.miss, &sbt.hit, &sbt.call, context.swapchain.extent.width, context.swapchain.extent.height, 1);
+            constants.tile_cuts = static_cast<i32>(state.tile_light_cuts);
+            constants.sampler_mode = static_cast<u32>(state.sampler_mode);
+            constants.frame_number = frame_number;
+            constants.restir_candidates = state.restir ? static_cast<u32>(state.restir_candidates) : 0;
+            constants.restir_reuse = static_cast<i32>(restir_valid);
+            vkCmdPushConstants(cmd, rtx.pipeline.layout, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, sizeof(constants), &constants);
+            vkCmdTraceRays(cmd, &rtx.sbt.rgen, &rtx.sbt.miss, &rtx.sbt.hit, &rtx.sbt.call, context.swapchain.extent.width, context.swapchain.extent.height, 1);
             CHECKPOINT(cmd, "[POST] RAYTRACING");
+            write_timestamp(profiler, cmd, frame_index, "ray tracing");
+            reservoirs_valid = state.restir;
+            reservoir_num_lights = num_scene_lights;
+
+            // blend with the reprojected history of the previous frame (written by the previous submission
+            // on this queue), replaces the ray traced image before the post processing. svgf filters the
+            // accumulated image and needs the accumulated moments
+            bool accumulate = state.temporal_accumulation || state.denoise;
+            if (accumulate)
+            {
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, temporal_accumulation_compute_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, temporal_accumulation_compute_pipeline.layout, 0, 
+                        1, &frame_resources[frame_index].descriptor_sets[13], 0, nullptr);
+                struct
+                {
+                    u32 max_history;
+                    i32 reset; // boolean
+                } constants;
+                constants.max_history = static_cast<u32>(state.max_history);
+                constants.reset = static_cast<i32>(!history_valid);
+                vkCmdPushConstants(cmd, temporal_accumulation_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatch(cmd, group_count(context.swapchain.extent.width, ACCUMULATION_WORKGROUP_SIZE), 
+                        group_count(context.swapchain.extent.height, ACCUMULATION_WORKGROUP_SIZE), 1);
+                write_timestamp(profiler, cmd, frame_index, "temporal accumulation");
+            }
+            history_valid = accumulate;
+
+            // svgf: variance estimation and the a-trous iterations, each one a pass with its own timing.
+            // sets 14 and 15 swap the two filter images, the variance is written to svgf_filter[0]
+            if (state.denoise)
+            {
+                static const char* atrous_names[SVGF_MAX_ITERATIONS] = { 
+                    "svgf a-trous 1", "svgf a-trous 2", "svgf a-trous 3", "svgf a-trous 4", "svgf a-trous 5" 
+                };
+                u32 group_count_x = group_count(context.swapchain.extent.width, SVGF_WORKGROUP_SIZE);
+                u32 group_count_y = group_count(context.swapchain.extent.height, SVGF_WORKGROUP_SIZE);
+
+                compute_barrier(cmd);
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, svgf_variance_compute_pipeline.handle);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, svgf_variance_compute_pipeline.layout, 0, 
+                        1, &frame_resources[frame_index].descriptor_sets[15], 0, nullptr);
+                vkCmdDispatch(cmd, group_count_x, group_count_y, 1);
+                write_timestamp(profiler, cmd, frame_index, "svgf variance");
+
+                i32 iterations = MIN(MAX(state.denoise_iterations, 1), SVGF_MAX_ITERATIONS);
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, svgf_atrous_compute_pipeline.handle);
+                for (i32 i = 0; i < iterations; ++i)
+                {
+                    compute_barrier(cmd);
+                    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, svgf_atrous_compute_pipeline.layout, 0, 
+                            1, &frame_resources[frame_index].descriptor_sets[14 + (i & 1)], 0, nullptr);
+                    struct
+                    {
+                        i32 iteration;
+                        i32 last_iteration; // boolean
+                    } constants;
+                    constants.iteration = i;
+                    constants.last_iteration = static_cast<i32>(i == iterations - 1);
+                    vkCmdPushConstants(cmd, svgf_atrous_compute_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                    vkCmdDispatch(cmd, group_count_x, group_count_y, 1);
+                    write_timestamp(profiler, cmd, frame_index, atrous_names[i]);
+                }
+            }
         }
 
-        end_timer(profiler,cmd);
+        end_timer(profiler, cmd, frame_index);
         VK_CHECK( vkEndCommandBuffer(cmd) );
-        VkPipelineStageFlags dst_wait_mask[2] = { VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR };
-        VkSemaphore wait_sempahores[2] = { frame->present_semaphore, upload_complete };
+        // the tile light cuts read the tree and the camera in a compute shader, all commands wait for 
+        // the build so the begin timestamp is written after the wait (the first timing does not include it)
+        VkPipelineStageFlags rt_wait_mask = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        VkPipelineStageFlags dst_wait_mask[2] = { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, rt_wait_mask };
+        VkSemaphore wait_sempahores[2] = { frame_resources[frame_index].build_semaphore, upload_complete };
         VkSubmitInfo submit_info = {};
         submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submit_info.pNext = nullptr;
-        submit_info.waitSemaphoreCount = 2;
+        submit_info.waitSemaphoreCount = lights_uploaded ? 1 : 2; // the upload was waited on by the build
         submit_info.pWaitSemaphores = wait_sempahores;
         submit_info.pWaitDstStageMask = dst_wait_mask;
         submit_info.commandBufferCount = 1;
         submit_info.pCommandBuffers = &cmd;
         submit_info.signalSemaphoreCount = 1;
         submit_info.pSignalSemaphores = &frame_resources[frame_index].rt_semaphore;
-        VK_CHECK( vkQueueSubmit(context.q_compute, 1, &submit_info, frame_resources[frame_index].rt_fence) );
+        VK_CHECK( vkQueueSubmit(context.q_graphics, 1, &submit_info, frame_resources[frame_index].rt_fence) );
 
         /* 
          * Copy the debugging info into a local buffer and update the render state
          * such that imgui can display this information
          */
-        if (ENABLE_VERIFY)
+        state.tree_read_back = state.read_back_tree && debug_tree;
+        state.quant_unbounded_lights = -1;
+        if (state.tree_read_back)
         {
-            //LOG_INFO("COMPUTE TIME %lf", get_results(profiler));
             // compute to local
             cmd = frame_resources[frame_index].cmd_dwn;
             VK_CHECK( begin_command_buffer(cmd) ); 
-            u32 h = static_cast<u32>(log2(num_leaf_nodes));
-            u32 node_count = ((1 << (h + 1)) - 1);
+            u32 node_count = static_cast<u32>(num_nodes);
 
             u32 size_light_tree = sizeof(node_t) * node_count;
             u32 size_selected_nodes = sizeof(i32) * node_count;
-            u32 size_selected_leafs = sizeof(i32) * num_leaf_nodes;
-            u32 size = size_light_tree + size_selected_nodes + size_selected_leafs;
+            u32 size_selected_leafs = sizeof(i32) * MIN(num_scene_lights, MAX_DEBUG_LIGHTS); // indexed by light id
+            u32 size_quant_tree = is_quant ? sizeof(quant_node_t) * node_count : 0;
+            u32 size = size_light_tree + size_selected_nodes + size_selected_leafs + size_quant_tree;
 
             buffer_t local;
             create_buffer(context, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &local,
@@ -1206,6 +2474,14 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             copy_leafs.size = size_selected_leafs;
             vkCmdCopyBuffer(cmd, frame_resources[frame_index].sbo_leaf_select.handle, local.handle, 1, &copy_leafs);
 
+            if (is_quant)
+            {
+                VkBufferCopy copy_quant = {};
+                copy_quant.dstOffset = size_light_tree + size_selected_nodes + size_selected_leafs;
+                copy_quant.size = size_quant_tree;
+                vkCmdCopyBuffer(cmd, frame_resources[frame_index].sbo_light_tree_quant.handle, local.handle, 1, &copy_quant);
+            }
+
             VK_CHECK( vkEndCommandBuffer(cmd) );
 
             VkPipelineStageFlags _dst_wait_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
@@ -1215,8 +2491,8 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             submit_info.signalSemaphoreCount = 0;
             submit_info.pSignalSemaphores = &frame->render_semaphore;
             submit_info.pCommandBuffers = &cmd;
-            VK_CHECK( vkQueueSubmit(context.q_transfer, 1, &submit_info, nullptr) ); 
-            VK_CHECK( wait_for_queue(context.q_transfer) );
+            VK_CHECK( vkQueueSubmit(context.q_graphics, 1, &submit_info, nullptr) ); 
+            VK_CHECK( wait_for_queue(context.q_graphics) );
 
             u8* p_data;
             context.allocator.map_memory(local.allocation, (void**)&p_data);
@@ -1245,6 +2521,16 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
                 memcpy(&state.selected_leafs, ptr, size_selected_leafs);
             }
 
+            // check that the decoded bounds of the quantized tree still enclose all lights
+            if (is_quant && num_lights > 0 && gpu_lights.count == 0) // gpu lights are not on the cpu
+            {
+                auto* tree = reinterpret_cast<node_t*>(p_data);
+                auto* quant = reinterpret_cast<quant_node_t*>(p_data + size_light_tree + size_selected_nodes + size_selected_leafs);
+                std::vector<light_t> lights(scene.static_lights);
+                lights.insert(lights.end(), scene.lights.begin(), scene.lights.end());
+                state.quant_unbounded_lights = static_cast<i32>(count_unbounded_lights(tree[node_count - 1], quant, node_count, lights));
+            }
+
             context.allocator.unmap_memory(local.allocation);
             destroy_buffer(context, local);
         }
@@ -1266,7 +2552,7 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
         vkCmdBeginRenderPass(cmd, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
         VkDeviceSize offsets[1] = {0};
-        if (state.render_bboxes || state.render_sample_lines)
+        if (render_bboxes || state.render_sample_lines)
         {
             vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, lines_pipeline.handle);
             VkDescriptorSet sets[2] = { 
@@ -1288,15 +2574,15 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
         constants.is_bbox = 1;
         constants.only_selected = static_cast<i32>(state.render_only_selected_nodes);
         constants.highlight = vec3(1,0,0);
-        constants.offset = num_leaf_nodes;
+        constants.offset = first_inner_node;
 
-        if (state.render_bboxes)
+        if (render_bboxes)
         {
             vkCmdBindVertexBuffers(cmd, 0, 1, &frame_resources[frame_index].vbo_lines.handle, offsets);
             vkCmdPushConstants(cmd, lines_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
             u32 h = static_cast<u32>(log2(num_leaf_nodes));
-            u32 vertex_count = 24 * ((1 << h) - 1);
-            if (state.render_step_mode)
+            u32 vertex_count = 24 * num_inner_nodes;
+            if (state.render_step_mode && !is_lbvh)
             {
                 u32 _h = h == 0 ? 0 : h - 1;
                 u32 s = MIN(state.step, h);
@@ -1327,7 +2613,7 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
             vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, points_pipeline.layout, 0,
                     1, &frame_resources[frame_index].descriptor_sets[0], 0, nullptr);
             vkCmdBindVertexBuffers(cmd, 0, 1, &frame_resources[frame_index].ubo_light.handle, offsets);
-            vkCmdDraw(cmd, num_lights, 1, 0, 0);
+            vkCmdDraw(cmd, num_scene_lights, 1, 0, 0);
         }
 
         vkCmdEndRenderPass(cmd);
@@ -1363,11 +2649,12 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
         vkCmdEndRenderPass(cmd);
         VK_CHECK( vkEndCommandBuffer(cmd) );
 
-        VkPipelineStageFlags _dst_wait_mask[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-        VkSemaphore wait_semaphores[2] = {frame_resources[frame_index].rt_semaphore, frame_resources[frame_index].prepass_semaphore};
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = &wait_semaphores[1];
-        submit_info.pWaitDstStageMask = &_dst_wait_mask[1];
+        // the read back already waited on the ray tracing
+        VkPipelineStageFlags _dst_wait_mask[3] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+        VkSemaphore wait_semaphores[3] = {frame->present_semaphore, frame_resources[frame_index].prepass_semaphore, frame_resources[frame_index].rt_semaphore};
+        submit_info.waitSemaphoreCount = state.tree_read_back ? 2 : 3;
+        submit_info.pWaitSemaphores = wait_semaphores;
+        submit_info.pWaitDstStageMask = _dst_wait_mask;
         submit_info.signalSemaphoreCount = 1;
         submit_info.pSignalSemaphores = &frame->render_semaphore;
         submit_info.pCommandBuffers = &cmd;
@@ -1377,6 +2664,7 @@ void renderer_t::draw_scene(scene_t& scene, camera_t& camera, render_state_t& st
 
     //graphics_submit_frame(context, frame);
     present_frame(context, frame);
+    frame_number++;
 }
 
 
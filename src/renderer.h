@@ -6,13 +6,21 @@
 #include "pipeline.h"
 #include "descriptor.h"
 #include "profiler.h"
+#include "shader_data.h"
+#include "light_tree.h"
 #include "ui.h"
 
-#define MAX_LIGHTS_SAMPLED 32
+#include <unordered_map>
+
+#define MAX_LIGHTS_SAMPLED MAX_CUT_SIZE // one sample ray line per node of the cut
 #define MAX_ENTITIES 100
-#define MAX_TREE_HEIGTH 17
-#define MAX_LIGHTS (1 << MAX_TREE_HEIGTH)
-#define MAX_LIGHT_TREE_SIZE (1 << (MAX_TREE_HEIGTH + 1))
+#define MIN_LIGHT_CAPACITY 1024
+#define MAX_STATIC_LIGHTS (1 << 18) // the static tree is built on the cpu
+
+// the tree is only read back for the debug view and drawn as bboxes up to this size
+#define MAX_DEBUG_TREE_HEIGTH 17
+#define MAX_DEBUG_LIGHTS (1 << MAX_DEBUG_TREE_HEIGTH)
+#define MAX_DEBUG_TREE_SIZE (1 << (MAX_DEBUG_TREE_HEIGTH + 1))
 
 struct scene_t;
 struct camera_t;
@@ -29,10 +37,46 @@ struct frame_resource_t
     buffer_t ubo_scene;
     image_t  storage_image;
     VkSampler storage_image_sampler;
+    image_t  history_color;    // temporal accumulation, read by the next frame
+    image_t  history_geometry; // normal and distance to the camera of the history pixels
+    image_t  history_moments;  // first and second moment of the luminance (svgf)
+    image_t  svgf_filter[2];   // ping-pong images of the a-trous iterations (color, variance)
 
-    buffer_t ubo_bounds;
+    buffer_t sbo_light_bounds;
+    buffer_t sbo_light_animation;    // animation groups of the gpu lights
+    buffer_t sbo_light_dispatch;     // sizes and indirect dispatch arguments of the light tree build
+    buffer_t sbo_light_bounds_partial; // min and max per workgroup of the bounds reduction
     buffer_t sbo_encoded_lights;
+    buffer_t sbo_encoded_lights_tmp; // radix sort ping-pong buffer
+    buffer_t sbo_radix_histogram;
+    buffer_t sbo_radix_scan_sums; // block totals of the levels of the radix scan
     buffer_t sbo_light_tree;
+    buffer_t sbo_light_tree_parents; // lbvh only
+    buffer_t sbo_light_tree_flags;   // lbvh only
+    buffer_t sbo_light_tree_cost;    // host visible, surface area of the inner nodes
+    buffer_t sbo_light_tree_wide;    // 4-wide tree collapsed from sbo_light_tree
+    buffer_t sbo_light_tree_quant;   // 16 byte nodes quantized from sbo_light_tree
+    buffer_t sbo_traversal_result;   // written by the traversal benchmark
+    buffer_t sbo_light_tree_static;  // tree of the static lights (two-level tree)
+    buffer_t sbo_tree_validation;     // host visible, errors found by light_tree_validate.comp
+    buffer_t sbo_tree_validation_ids; // leaf nodes per light id
+    buffer_t sbo_tile_cuts;           // light cut per screen tile (light_cut_tiles.comp)
+    buffer_t sbo_reservoirs;          // reservoir per pixel of the light resampling, read by the next frame
+
+    u32  light_capacity = 0; // power of 2, the light buffers are grown to fit the scene lights
+    u32  lights_version = 0; // version of the scene lights in ubo_light and the light tree
+    u32  static_lights_version = 0; // version of the static lights in ubo_light and sbo_light_tree_static
+    u32  light_animation_version = 0; // version of the gpu light groups in sbo_light_animation
+
+    // the tree in this frame's buffers can be refitted if the lights only moved
+    i32  tree_num_lights = -1; // -1 = needs a full rebuild
+    i32  tree_type = -1;
+    i32  morton_key_mode = -1;
+    bool tree_cost_written = false; // cost buffer holds the partial sums of the last built tree
+    bool tree_rebuilt = false; // cost buffer holds the cost of a fully rebuilt tree
+    f32  tree_cost = 0.0f;
+    f32  tree_rebuild_cost = 0.0f;
+    bool tree_validated = false; // validation buffer holds the errors of the last built tree
 
     // here are bbox lines writen
     buffer_t vbo_lines;
@@ -46,6 +90,7 @@ struct frame_resource_t
     VkFence rt_fence;
     VkSemaphore rt_semaphore;
     VkSemaphore prepass_semaphore;
+    VkSemaphore build_semaphore; // light tree build (compute queue) done, waited on by the ray tracing
 
     VkCommandBuffer cmd;
     VkCommandBuffer cmd_prepass;
@@ -60,6 +105,24 @@ struct cut_t
 	i32 selected;
 };
 
+enum sort_mode_t
+{
+    SORT_MODE_BITONIC = 0,
+    SORT_MODE_RADIX   = 1,
+};
+
+enum tree_build_mode_t
+{
+    TREE_BUILD_PER_LEVEL = 0, // one dispatch per level
+    TREE_BUILD_FUSED     = 1, // reduce LIGHT_TREE_FUSED_LEVELS levels per dispatch in shared memory
+};
+
+enum tree_update_mode_t
+{
+    TREE_UPDATE_REBUILD = 0, // encode, sort and build every frame
+    TREE_UPDATE_REFIT   = 1, // keep the previous sorted order and only update the bounds
+};
+
 struct render_state_t
 {
     i32  cut_size = 1;
@@ -76,14 +139,61 @@ struct render_state_t
 
     bool use_random_lights = false;
     i32  num_random_lights = 1;
+    i32  num_static_lights = 0; // random lights that do not move (two-level tree with the complete tree)
+    f32  spot_cone_angle = 180.0f; // degrees, random lights below 180 are spot lights with random directions
     f32  distance_from_origin = 1;
+    bool gpu_lights = false; // random lights are generated and animated on the gpu (light_animate.comp)
+    f64  time = 0.0; // seconds the renderer was not paused, drives the animation of the gpu lights
+    i32  sort_mode = SORT_MODE_RADIX;
+    i32  tree_build_mode = TREE_BUILD_FUSED;
+    i32  tree_type = LIGHT_TREE_TYPE_COMPLETE;
+    i32  morton_key_mode = MORTON_KEY_POSITION; // MORTON_KEY_*, extended keys also group lights by color or orientation
+    i32  tree_update_mode = TREE_UPDATE_REFIT;
+    f32  refit_threshold = 1.5f; // rebuild when the tree cost grew by this factor since the last rebuild
+    bool always_rebuild_tree = false; // also build the tree if the lights did not change (for timings)
+    bool benchmark_traversal = false; // time traversing the binary and the 4-wide or quantized tree
+    bool read_back_tree = false; // copy the tree to the host for the debug view (waits for the frame to finish)
+    bool tile_light_cuts = false; // one light cut per LIGHT_CUT_TILE_SIZE^2 pixels instead of one per pixel
+    i32  sampler_mode = SAMPLER_BLUE_NOISE; // SAMPLER_*, random numbers of the light selection
+    bool temporal_accumulation = false; // blend the frames with the reprojected history (the models do not move)
+    i32  max_history = 32; // frames blended at most, lower reacts faster to moving lights
+    bool denoise = false; // svgf denoiser after the ray tracing (also accumulates)
+    i32  denoise_iterations = SVGF_MAX_ITERATIONS; // a-trous iterations, the filter cost grows linearly
+    bool restir = false; // resample the selected lights with reservoirs, one shadow ray per sample
+    i32  restir_candidates = 4; // rounds of select_lights resampled per sample
 
     // todo
     bool paused = false;
   
     // debugging info passed on for imgui to use
     cut_t *cut;
-    i32 selected_leafs[MAX_LIGHTS] = {};
+    i32 num_nodes = 0;
+    i32 num_leaf_nodes = 0;
+    bool tree_read_back = false; // cut and selected_leafs are valid (tree fits the debug view)
+    tree_validation_t tree_validation = {}; // errors in the last validated tree (see ENABLE_VERIFY)
+    bool tree_validation_ok = true;
+    u32 invalid_trees = 0; // validated trees with errors since the start
+    i32 selected_leafs[MAX_DEBUG_LIGHTS] = {};
+    std::vector<timestamp_t> timings; // gpu time per stage of a previous frame
+    f64 gpu_time[PROFILER_QUEUE_COUNT] = {}; // timed command buffers per queue
+    bool tree_unchanged = false; // lights did not change, tree of the previous build was used
+    bool tree_refitted = false;
+    f32 tree_cost = 0.0f; // summed surface area of the inner nodes divided by the root's
+    f32 tree_rebuild_cost = 0.0f;
+    i32 quant_unbounded_lights = -1; // lights outside of the decoded bounds of the quantized tree (-1 = not checked)
+    bool two_level_tree = false; // num_nodes and num_leaf_nodes are the tree of the dynamic lights
+    f64 static_tree_build_ms = 0.0; // cpu build (or cache load) of the last static tree
+    bool static_tree_cached = false; // last static tree was loaded from LIGHT_TREE_CACHE_PATH
+    bool static_lights_editing = false; // a slider that changes the static lights is held (they are not committed yet)
+    bool run_tree_benchmark = false; // compare the saoh and the morton tree once (static lights or all lights)
+    light_tree_benchmark_t tree_benchmark;
+};
+
+// ray tracing pipeline specialized for a light cut capacity, sample count and debug view
+struct rtx_variant_t
+{
+    pipeline_t             pipeline;
+    shader_binding_table_t sbt;
 };
 
 struct renderer_t
@@ -97,6 +207,8 @@ struct renderer_t
     image_t                color_attachment[BUFFERED_FRAMES];
     VkSampler              color_sampler[BUFFERED_FRAMES];
     image_t                depth_attachment[BUFFERED_FRAMES];
+    image_t                motion_attachment[BUFFERED_FRAMES]; // screen space motion since the previous frame
+    image_t                albedo_attachment[BUFFERED_FRAMES]; // base color of the materials (svgf)
     VkSampler              depth_sampler[BUFFERED_FRAMES];
     VkFramebuffer          prepass_framebuffer[BUFFERED_FRAMES];
     VkRenderPass           prepass_render_pass;
@@ -104,30 +216,53 @@ struct renderer_t
     VkFramebuffer          bbox_framebuffers[BUFFERED_FRAMES];
     VkRenderPass           bbox_render_pass;
 
-    pipeline_t             prepass_pipeline; // render the depth and albedo in a prepass
+    pipeline_t             prepass_pipeline; // render the depth and world normals in a prepass
     pipeline_t             debug_pipeline;
-    pipeline_t             rtx_pipeline; // renders the scene 
+    rt_pipeline_description_t rtx_description; // renders the scene, built per variant with get_rtx_variant
+    std::unordered_map<u32, rtx_variant_t> rtx_variants; // built variants by key (see get_rtx_variant)
     pipeline_t             query_pipeline; // query if a ray hits a triangle in the scene
     pipeline_t             post_pipeline; // hdr post processing 
     pipeline_t             points_pipeline; // render the light sources as colored points
     pipeline_t             lines_pipeline; // render lines
     
     // compute pipelines
+    pipeline_t             light_animate_compute_pipeline; // generates and animates the gpu lights
+    pipeline_t             light_dispatch_compute_pipeline; // writes the indirect dispatch arguments of the light tree build
+    pipeline_t             light_bounds_compute_pipeline; // reduces the light positions to the bounds of all lights
     pipeline_t             morton_compute_pipeline; // encodes light sources with their morton encoding
     pipeline_t             sort_compute_pipeline;  // bitonic sort
+    pipeline_t             radix_histogram_pipeline; // radix sort: digit count per block
+    pipeline_t             radix_scan_pipeline; // radix sort: prefix sum of the digit counts (one level)
+    pipeline_t             radix_scan_add_pipeline; // radix sort: adds the scanned block totals to the level below
+    pipeline_t             radix_scatter_pipeline; // radix sort: write keys to sorted position
     pipeline_t             tree_leafs_compute_pipeline; // generate leaf nodes of the light tree
     pipeline_t             tree_compute_pipeline; // generate the inner nodes of the rest of the tree
+    pipeline_t             tree_fused_compute_pipeline; // generate leaf and inner nodes (multiple levels per dispatch)
+    pipeline_t             lbvh_internal_compute_pipeline; // generate the inner nodes of the lbvh (without bounds)
+    pipeline_t             lbvh_bounds_compute_pipeline; // generate leaf nodes and bounds of the lbvh bottom up
+    pipeline_t             tree_wide_compute_pipeline; // collapse the complete tree into a 4-wide tree
+    pipeline_t             tree_quant_compute_pipeline; // quantize the complete tree into 16 byte nodes
+    pipeline_t             traversal_compute_pipeline; // benchmark of the tree traversal
+    pipeline_t             tree_cost_compute_pipeline; // surface area of the tree, decides when a refit is not good enough
+    pipeline_t             tree_validate_compute_pipeline; // checks the tree of the dynamic lights on the gpu
+    pipeline_t             light_cut_tiles_compute_pipeline; // light cut per screen tile from the prepass
+    pipeline_t             temporal_accumulation_compute_pipeline; // blends the ray traced image with the reprojected history
+    pipeline_t             svgf_variance_compute_pipeline; // svgf: variance of the luminance per pixel
+    pipeline_t             svgf_atrous_compute_pipeline; // svgf: one iteration of the edge-aware wavelet filter
     pipeline_t             bbox_lines_pso; // generate the lines for displaying the bboxes
 
-    shader_binding_table_t sbt;
     shader_binding_table_t query_sbt;
     staging_buffer_t       staging;
 
-    // used to clear some gpu buffers
-    void* empty_buffer = nullptr;
-
     // shared by all frames 
     buffer_t ray_lines_info;
+    buffer_t sbo_blue_noise; // BLUE_NOISE_SIZE^2 tile of the blue noise sampler
+    u32 frame_number = 0; // frames drawn, indexes the sample sequences of the pixels
+    m4x4 prev_view_proj; // camera of the previous frame, for the motion vectors
+    v3   prev_camera_pos;
+    bool history_valid = false; // the previous frame wrote its accumulation history
+    bool reservoirs_valid = false; // the previous frame wrote its reservoirs
+    i32  reservoir_num_lights = 0; // lights when the reservoirs were written
 
     std::vector<frame_resource_t> frame_resources;
     descriptor_allocator_t descriptor_allocator;
@@ -138,8 +273,10 @@ struct renderer_t
 
     void draw_scene(scene_t& scene, camera_t& camera, render_state_t& state);
     void update_descriptors(scene_t& scene);
+    void resize_light_buffers(frame_resource_t& resource, u32 capacity);
     void create_prepass_render_pass();
     void create_bbox_render_pass();
+    rtx_variant_t& get_rtx_variant(const render_state_t& state, bool debug_view);
 };
 
 #endif // RENDERER_H
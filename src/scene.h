@@ -29,10 +29,32 @@ struct mesh_t
     VkBuffer ibo;
 };
 
+// dynamic lights that only exist on the gpu, generated from the seed and moved every frame by light_animate.comp 
+// (scene_t::lights stays empty while count > 0)
+struct gpu_lights_t
+{
+    u32 count = 0;
+    u32 seed = 1;
+    f32 distance = 1.0f; // from the origin
+    f32 cone_angle = LIGHT_CONE_OMNI;
+    v3  offset = vec3(0); // moved with move_lights
+    light_animation_t groups[LIGHT_ANIMATION_GROUPS] = {};
+    u32 groups_version = 1; // incremented on every change to the groups
+};
+
 struct scene_t
 {
     std::vector<entity_t> entities;
     std::vector<light_t>  lights;
+    u32 lights_version = 1; // incremented on every change to the lights
+
+    // lights that do not move, their tree is only built when they change (see LIGHT_TREE_STATIC_BIT)
+    std::vector<light_t>  static_lights;
+    u32 static_lights_version = 1;
+    std::vector<node_t>   static_tree; // saoh tree of the static lights (lbvh layout), built when they are committed
+
+    // changes to everything but the groups are tracked by lights_version
+    gpu_lights_t gpu_lights;
 
     buffer_t vbo;
     buffer_t ibo;
@@ -50,9 +72,51 @@ inline void add_entity(scene_t& scene, u32 mesh_id, i32 material_index, m4x4 m_m
     scene.entities.emplace_back(entity_t{m_model, material_index, mesh_id});
 }
 
-inline void add_light(scene_t& scene, v3 pos, v3 color)
+// call after changing the lights directly so the renderer uploads them and rebuilds the light tree
+inline void update_lights_version(scene_t& scene)
+{
+    scene.lights_version++;
+}
+
+inline void update_static_lights_version(scene_t& scene)
+{
+    scene.static_lights_version++;
+}
+
+inline void add_light(scene_t& scene, v3 pos, v3 color, v3 direction = vec3(0, -1, 0), f32 cone_angle = LIGHT_CONE_OMNI)
+{
+    scene.lights.emplace_back(light_t{vec4(pos, 1), vec4(color, 1), direction, cone_angle});
+    update_lights_version(scene);
+}
+
+inline void add_static_light(scene_t& scene, v3 pos, v3 color, v3 direction = vec3(0, -1, 0), f32 cone_angle = LIGHT_CONE_OMNI)
+{
+    scene.static_lights.emplace_back(light_t{vec4(pos, 1), vec4(color, 1), direction, cone_angle});
+    update_static_lights_version(scene);
+}
+
+// static and dynamic lights
+inline u32 light_count(const scene_t& scene)
+{
+    return static_cast<u32>(scene.static_lights.size() + scene.lights.size()) + scene.gpu_lights.count;
+}
+
+// the gpu lights have to be generated again every frame
+inline bool gpu_lights_animated(const scene_t& scene)
 {
-    scene.lights.emplace_back(light_t{vec4(pos, 1), vec4(color, 1)});
+    if (scene.gpu_lights.count == 0)
+    {
+        return false;
+    }
+    for (const auto& group : scene.gpu_lights.groups)
+    {
+        if (group.orbit_speed != 0.0f || group.flicker != 0.0f 
+                || (group.translation_frequency != 0.0f && length(group.translation) > 0.0f))
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 inline void add_material(scene_t& scene, material_t& material)
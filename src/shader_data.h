@@ -20,6 +20,10 @@
 #define bool     i32
 #endif
 
+// half angle of the emission cone of point lights (emit in all directions)
+#define LIGHT_CONE_OMNI 3.1415926535
+
+// spot lights emit inside of the cone around direction (falls off to 0 at cone_angle)
 struct light_t
 {
 #ifdef GLSL
@@ -30,6 +34,8 @@ struct light_t
     aligned_v3 pos;
     aligned_v3 color;
 #endif
+    vec3  direction;
+    float cone_angle; // LIGHT_CONE_OMNI = point light
 };
 
 struct material_t
@@ -64,20 +70,165 @@ struct camera_ubo_t
     mat4 proj;
     mat4 inv_view;
     mat4 inv_proj;
+    mat4 prev_view_proj; // camera of the previous frame (motion vectors and reprojection)
+#ifndef GLSL
+    aligned_v3 prev_pos;
+#else
+    vec3 prev_pos;
+#endif
 };
 
+// 63 bit morton code (21 bits per axis)
 struct encoded_t
 {
-    uint code;
+    uint code_hi;
+    uint code_lo;
     uint id;
 };
 
+// keys of the morton encoding: position only (21 bits per axis) or 3 bits of a light attribute
+// interleaved with the top 3 levels of the position (20 bits per axis) as a fourth dimension,
+// so lights of a similar color or orientation end up in the same subtrees
+#define MORTON_KEY_POSITION    0
+#define MORTON_KEY_COLOR       1 // hue of the light color
+#define MORTON_KEY_ORIENTATION 2 // octant of the spot direction
+#define MORTON_ATTRIBUTE_BITS  3
+
+// radix sort of the encoded lights (8 bits per pass, 64 bit keys)
+#define RADIX_SORT_BITS 8
+#define RADIX_SORT_PASSES 8
+#define RADIX_SORT_BUCKETS (1 << RADIX_SORT_BITS)
+#define RADIX_SORT_WORKGROUP_SIZE 256
+#define RADIX_SORT_BLOCK_SIZE 1024 // keys handled by one workgroup
+#define RADIX_SCAN_BLOCK_SIZE 1024 // digit counts scanned by one workgroup
+#define RADIX_SCAN_MAX_LEVELS 4    // scans up to RADIX_SCAN_BLOCK_SIZE^4 digit counts
+
+// cone_axis and cone_angle bound the emission cones of all lights in the node 
+// (cone_angle >= LIGHT_CONE_OMNI = the node can emit in every direction)
 struct node_t
 {
     vec3  bbox_min;
     float intensity;
     vec3  bbox_max;
     uint  id;
+    vec3  cone_axis;
+    float cone_angle;
+};
+
+// complete binary tree: 2^h leaf nodes (padded with dummy nodes) stored at the start of the array 
+// followed by the levels above them, the root is the last node
+// inner node id = array index, leaf node id = light index 
+#define LIGHT_TREE_TYPE_COMPLETE 0
+
+// lbvh (karras): n - 1 inner nodes (root = 0) followed by the n leaf nodes
+// inner node id = split | left child is leaf << 31 | right child is leaf << 30
+// where the children are inner nodes split, split + 1 or leaf nodes n - 1 + split, n + split
+#define LIGHT_TREE_TYPE_LBVH 1
+#define LBVH_LEFT_LEAF_BIT  0x80000000u
+#define LBVH_RIGHT_LEAF_BIT 0x40000000u
+#define LBVH_SPLIT_MASK     0x3fffffffu
+
+// 4-wide tree collapsed from the complete tree (keeps every second level), used for traversal only.
+// a node stores the bounds of its children as struct of arrays (128 bytes) so all of them are 
+// evaluated with one load, child = light index for leaf children else index of the child wide node
+#define LIGHT_TREE_TYPE_WIDE 2
+#define LIGHT_TREE_WIDTH 4
+
+struct wide_node_t
+{
+    vec4 bbox_min_x;
+    vec4 bbox_min_y;
+    vec4 bbox_min_z;
+    vec4 bbox_max_x;
+    vec4 bbox_max_y;
+    vec4 bbox_max_z;
+    vec4 intensity; // 0 = empty slot
+    uint child[LIGHT_TREE_WIDTH];
+};
+
+// complete tree with a 16 byte copy of every node for traversal, the bounds are quantized to 10 bits
+// per axis relative to the bounds of the parent (decoded bounds always enclose the original ones),
+// the root is quantized relative to the bounds of the root in the full precision tree
+#define LIGHT_TREE_TYPE_QUANTIZED 3
+#define LIGHT_TREE_QUANT_BITS 10
+#define LIGHT_TREE_QUANT_MAX ((1 << LIGHT_TREE_QUANT_BITS) - 1)
+
+struct quant_node_t
+{
+    uint  bbox_min; // x | y << 10 | z << 20, rounded down
+    uint  bbox_max; // rounded up
+    float intensity;
+    uint  id;
+};
+
+// two-level tree (complete tree only): the static lights are stored before the dynamic lights and have 
+// their own tree that is built once on the cpu (saoh, lbvh layout), the tree of the dynamic lights is built 
+// every frame. a top level root with the static and the dynamic root as children joins both trees,
+// node ids of the static tree (array index) have LIGHT_TREE_STATIC_BIT set
+#define LIGHT_TREE_STATIC_BIT 0x80000000u
+#define LIGHT_TREE_TOP_ROOT   0x7fffffffu
+
+// levels of the light tree reduced by one workgroup in shared memory
+// (2^9 nodes after the first merge, 24kb)
+#define LIGHT_TREE_FUSED_LEVELS 10
+
+// nodes in a light cut, the cut is refined with a max-heap of its nodes (lightcuts.inc)
+#define MAX_CUT_SIZE 64
+
+// specialization constant ids of the ray tracing pipeline variants (raytracing.rgen and raytracing.rchit)
+#define RT_CONSTANT_MAX_CUT_SIZE 0 // length of the light cut arrays (<= MAX_CUT_SIZE)
+#define RT_CONSTANT_NUM_SAMPLES  1 // samples per pixel, 0 = read from the push constants
+#define RT_CONSTANT_DEBUG        2 // write the debug lines and the selected nodes
+
+// light cut shared by the pixels of a LIGHT_CUT_TILE_SIZE x LIGHT_CUT_TILE_SIZE screen tile (light_cut_tiles.comp),
+// built for the centroid and the average normal of the prepass positions and normals in the tile. every pixel
+// still selects its lights in the subtrees of the cut with its own position and normal.
+// size = 0 if the tile has no geometry or its normals diverge (the pixels build their own cut)
+#define LIGHT_CUT_TILE_SIZE 8
+
+struct tile_cut_t
+{
+    uint size;
+    uint id[MAX_CUT_SIZE];
+};
+
+// random numbers of the light selection in raytracing.rchit (sampler.inc)
+#define SAMPLER_WHITE_NOISE 0 // hash of the pixel, the sample and the time
+#define SAMPLER_SOBOL       1 // owen scrambled sobol sequence per pixel, indexed by the frame and the sample
+#define SAMPLER_BLUE_NOISE  2 // tiled blue noise, rotated by the golden ratio per frame and sample
+#define BLUE_NOISE_SIZE     64 // texels per side of the blue noise tile
+
+// temporal accumulation of the ray traced image (temporal_accumulation.comp), the history of the previous frame is
+// reprojected with the prepass motion vectors and rejected where the surface or its normal does not match
+#define ACCUMULATION_WORKGROUP_SIZE 8
+#define ACCUMULATION_MAX_HISTORY 64
+
+// svgf denoiser (svgf_variance.comp, svgf_atrous.comp) after the temporal accumulation: the variance of the
+// luminance is estimated from the accumulated moments (spatially while the history is short) and steers
+// the edge-aware a-trous wavelet filter, the depth, normals and albedo of the prepass stop it at edges
+#define SVGF_WORKGROUP_SIZE 8
+#define SVGF_MAX_ITERATIONS 5 // filter footprint of 2^(iterations + 1) + 1 pixels
+#define SVGF_MIN_HISTORY 4 // frames of history below which the variance is estimated spatially
+
+// resampled importance sampling of the lights (restir.inc): every pixel resamples the lights selected in its light
+// cut (restir_candidates rounds of select_lights) into a reservoir with their unshadowed contribution, then reuses
+// the reservoirs of the previous frame at its reprojected position and around it. one shadow ray is traced for
+// the light picked by the reservoir
+#define RESTIR_MAX_CANDIDATES     8  // rounds of candidates per pixel
+#define RESTIR_SPATIAL_SAMPLES    4  // neighbouring reservoirs of the previous frame
+#define RESTIR_SPATIAL_RADIUS     16 // pixels
+#define RESTIR_MAX_HISTORY        20 // the reused reservoirs count at most as many candidates as this many frames
+
+struct reservoir_t
+{
+    vec3  position; // surface of the pixel
+    uint  light;    // INVALID_ID = empty
+    vec3  normal;
+    float W;        // contribution weight of the light (0 if it was shadowed)
+    uint  M;        // candidates seen
+#ifndef GLSL
+    u32 _pad[3];
+#endif
 };
 
 struct mesh_info_t
@@ -103,6 +254,10 @@ struct query_output_t
     uint primitive_id;
 };
 
+// bounds of all lights, reduced on the gpu in two passes (light_bounds.comp)
+#define LIGHT_BOUNDS_WORKGROUP_SIZE 512
+#define LIGHT_BOUNDS_BLOCK_SIZE 4096 // lights reduced by one workgroup in the first pass
+
 struct light_bounds_t
 {
     vec3 origin;
@@ -111,6 +266,92 @@ struct light_bounds_t
     float  _p1;
 };
 
+// sizes of the stages of the light tree build, written on the gpu by light_dispatch.comp from num_lights so 
+// the stages are dispatched with vkCmdDispatchIndirect and read the number of lights and nodes from here 
+// (num_lights can be written by a gpu pass without a round trip to the host)
+#define LIGHT_DISPATCH_BOUNDS      0 // light_bounds.comp first pass (blocks of LIGHT_BOUNDS_BLOCK_SIZE lights)
+#define LIGHT_DISPATCH_SORT_NODES  1 // morton_encode.comp, bitonic_sort.comp and light_tree_leaf_nodes.comp (512 per workgroup)
+#define LIGHT_DISPATCH_RADIX       2 // radix_sort_histogram.comp and radix_sort_scatter.comp (one block per workgroup)
+#define LIGHT_DISPATCH_INNER_NODES 3 // bbox_lines.comp and light_tree_lbvh_internal.comp (512 per workgroup)
+#define LIGHT_DISPATCH_LEAF_NODES  4 // light_tree_validate.comp (TREE_VALIDATION_WORKGROUP_SIZE per workgroup)
+#define LIGHT_DISPATCH_LIGHTS      5 // light_tree_validate.comp second pass
+#define LIGHT_DISPATCH_TREE_LEAFS  6 // light_tree_lbvh_bounds.comp (512 per workgroup)
+#define LIGHT_DISPATCH_ANIMATION   7 // light_animate.comp (LIGHT_ANIMATION_WORKGROUP_SIZE per workgroup)
+#define LIGHT_DISPATCH_NODES       8 // light_tree_quant.comp (512 per workgroup)
+#define LIGHT_DISPATCH_WIDE_NODES  9 // light_tree_wide.comp (512 per workgroup)
+#define LIGHT_DISPATCH_TREE_COST   10 // light_tree_cost.comp (512 inner nodes per workgroup, at least one)
+#define LIGHT_DISPATCH_TRAVERSAL   11 // light_tree_traversal.comp (TRAVERSAL_BENCHMARK_SAMPLES, none without a tree)
+#define LIGHT_DISPATCH_COUNT       12
+
+// the complete tree is built with one dispatch per level (light_tree.comp, levels[dst_level - 1]) or one dispatch 
+// per LIGHT_TREE_FUSED_LEVELS levels (light_tree_fused.comp, fused[pass]), the bitonic sort with one dispatch per 
+// step. the host records the dispatches for the capacity of the light buffers, the entries past the height 
+// of the tree are empty and the sort steps past num_sort_nodes return right away
+#define LIGHT_DISPATCH_MAX_LEVELS  32
+#define LIGHT_DISPATCH_MAX_FUSED   4 // LIGHT_DISPATCH_MAX_LEVELS / LIGHT_TREE_FUSED_LEVELS rounded up
+
+// random points traversed per tree layout when benchmarking the traversal (512 per workgroup)
+#define TRAVERSAL_BENCHMARK_SAMPLES (1 << 20)
+
+// VkDispatchIndirectCommand padded to 16 bytes
+struct dispatch_indirect_t
+{
+    uint x;
+    uint y;
+    uint z;
+    uint _pad;
+};
+
+struct light_dispatch_t
+{
+    uint num_lights;       // input, lights in the tree of the dynamic lights
+    uint num_gpu_lights;   // input, lights generated by light_animate.comp
+    uint num_sort_nodes;   // num_lights padded to a power of 2 with dummy nodes
+    uint num_leaf_nodes;   // complete tree: num_sort_nodes, lbvh: num_lights
+    uint num_nodes;        // 2 * num_leaf_nodes - 1 (0 without lights)
+    uint num_inner_nodes;
+    uint first_inner_node; // complete tree: num_leaf_nodes, lbvh: 0
+    uint root;             // array index, complete tree: num_nodes - 1, lbvh: 0
+    uint height;           // complete tree: log2(num_leaf_nodes)
+    uint num_wide_nodes;   // 4-wide tree collapsed from the complete tree
+    uint num_radix_blocks;
+    uint num_bounds_groups; // partial bounds of the first light bounds pass
+    uint radix_scan_count[RADIX_SCAN_MAX_LEVELS];  // values scanned per level (level 0: the digit counts, 0: unused level)
+    uint radix_scan_offset[RADIX_SCAN_MAX_LEVELS]; // start of a level > 0 in the block sums buffer
+    dispatch_indirect_t dispatch[LIGHT_DISPATCH_COUNT];
+    dispatch_indirect_t levels[LIGHT_DISPATCH_MAX_LEVELS];
+    dispatch_indirect_t fused[LIGHT_DISPATCH_MAX_FUSED];
+    dispatch_indirect_t radix_scan[RADIX_SCAN_MAX_LEVELS];     // radix_sort_scan.comp (one block per workgroup)
+    dispatch_indirect_t radix_scan_add[RADIX_SCAN_MAX_LEVELS]; // radix_sort_scan_add.comp, adds level l to level l - 1
+};
+
+// errors found by light_tree_validate.comp in the tree of the dynamic lights (0 = valid tree)
+#define TREE_VALIDATION_WORKGROUP_SIZE 512
+
+struct tree_validation_t
+{
+    uint bounds_errors;    // child outside of its parent's bounds or leaf not at its light
+    uint intensity_errors; // parent intensity is not the sum of its children or leaf not its light's intensity
+    uint id_errors;        // light missing from the leaf nodes, in them more than once or invalid leaf id
+    uint first_error_node; // array index of the first node with an error (0xffffffff = none)
+};
+
+// lights generated and animated on the gpu (light_animate.comp), light i belongs to group i % LIGHT_ANIMATION_GROUPS
+#define LIGHT_ANIMATION_WORKGROUP_SIZE 256
+#define LIGHT_ANIMATION_GROUPS 4
+
+struct light_animation_t
+{
+    vec3  translation; // amplitude of the back and forth movement
+    float translation_frequency;
+    float orbit_speed; // radians per second around the y axis through the origin
+    float flicker;     // 0 = constant color, 1 = goes dark
+    float flicker_frequency;
+#ifndef GLSL
+    f32 _pad;
+#endif
+};
+
 #ifndef GLSL
 #undef mat3
 #undef mat4 
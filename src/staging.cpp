@@ -4,9 +4,9 @@
 #include <cassert>
 #include <cstring>
 
-static void* get_next_mapped_data(staging_buffer_t& staging, VkDeviceSize& offset, u32 size)
+static void* get_next_mapped_data(staging_buffer_t& staging, VkDeviceSize& offset, VkDeviceSize size)
 {
-    assert(staging.used_space + size < staging.buffer.allocation.size);
+    assert(staging.used_space + size <= staging.buffer.allocation.size);
     offset = staging.used_space;
     staging.used_space += size;
     return static_cast<void*>((u8*)staging.mapped + offset);
@@ -90,24 +90,38 @@ void destroy_staging_buffer(staging_buffer_t& staging)
     vkDestroyCommandPool(staging.context->device, staging.command_pool, nullptr);
 }
 
-void copy_to_buffer(staging_buffer_t& staging, buffer_t& dst, u32 size, void* data, u64 offset)
+// data larger than the free space is copied in chunks, whenever the staging buffer is full the copies
+// recorded so far are submitted and begin_upload waits for them before the space is reused
+void copy_to_buffer(staging_buffer_t& staging, buffer_t& dst, u64 size, void* data, u64 offset)
 {
     assert(dst.handle);
 
-    VkDeviceSize src_offset;
-    void* p_data = get_next_mapped_data(staging, src_offset, size);
-
-    if (data)
+    u64 copied = 0;
+    while (copied < size)
     {
-        memcpy(p_data, data, size);
+        if (staging.used_space == staging.buffer.allocation.size)
+        {
+            end_upload(staging);
+            begin_upload(staging);
+        }
+        u64 chunk_size = MIN(size - copied, staging.buffer.allocation.size - staging.used_space);
+
+        VkDeviceSize src_offset;
+        void* p_data = get_next_mapped_data(staging, src_offset, chunk_size);
+
+        if (data)
+        {
+            memcpy(p_data, (u8*)data + copied, chunk_size);
+        }
+
+        VkBufferCopy copy{};
+        copy.srcOffset = src_offset;
+        copy.dstOffset = offset + copied;
+        copy.size = chunk_size;
+       
+        vkCmdCopyBuffer(staging.cmd, staging.buffer.handle, dst.handle, 1, &copy);
+        copied += chunk_size;
     }
-
-    VkBufferCopy copy{};
-    copy.srcOffset = src_offset;
-    copy.dstOffset = offset;
-    copy.size = size;
-   
-    vkCmdCopyBuffer(staging.cmd, staging.buffer.handle, dst.handle, 1, &copy);
 }
 
 void copy_to_image(staging_buffer_t& staging, VkImage image, u32 width, u32 height, void* data)
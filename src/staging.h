@@ -3,7 +3,8 @@
 
 #include "backend.h"
 
-#define STAGING_DEFAULT_ALLOCATION_SIZE 64 * 1024 * 1024
+// larger buffer uploads are split into chunks by copy_to_buffer
+#define STAGING_DEFAULT_ALLOCATION_SIZE 128 * 1024 * 1024
 
 /* Essentially a linear allocator
  * that gets reset after uploading data everytime */
@@ -25,7 +26,8 @@ void end_upload(staging_buffer_t& staging, VkSemaphore* upload_complete = nullpt
 
 void init_staging_buffer(staging_buffer_t& staging, gpu_context_t* p_context);
 void destroy_staging_buffer(staging_buffer_t& staging);
-void copy_to_buffer(staging_buffer_t& staging, buffer_t& buffer, u32 size, void* data, u64 offset = 0);
+// submits and waits for the pending copies if the data does not fit into the staging buffer
+void copy_to_buffer(staging_buffer_t& staging, buffer_t& buffer, u64 size, void* data, u64 offset = 0);
 void copy_to_image(staging_buffer_t& staging, VkImage image, u32 width, u32 height, void* data); 
 //void reset(staging_buffer_t& staging);
 
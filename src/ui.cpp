@@ -57,12 +57,79 @@ bool new_frame(imgui_t& imgui, render_state_t* state, scene_t* scene, frame_time
     if (!state->render_bboxes) 
         ImGui::EndDisabled();
     ImGui::SliderInt("Samples ppx", &state->num_samples, 1, 16);
-    ImGui::SliderInt("Cut size", &state->cut_size, 1, MIN(static_cast<i32>(scene->lights.size()), 32));
+    ImGui::SliderInt("Cut size", &state->cut_size, 1, MIN(static_cast<i32>(light_count(*scene)), MAX_CUT_SIZE));
+    ImGui::Checkbox("Light cut per tile", &state->tile_light_cuts);
+    ImGui::Checkbox("Resampling (ReSTIR)", &state->restir);
+    if (state->restir)
+    {
+        ImGui::SliderInt("Candidate rounds", &state->restir_candidates, 1, RESTIR_MAX_CANDIDATES);
+    }
+    ImGui::Combo("Sampler", &state->sampler_mode, "White noise\0Sobol (owen scrambled)\0Blue noise\0");
+    ImGui::Checkbox("Temporal accumulation", &state->temporal_accumulation);
+    ImGui::Checkbox("Denoiser (SVGF)", &state->denoise);
+    if (state->denoise)
+    {
+        ImGui::SliderInt("Filter iterations", &state->denoise_iterations, 1, SVGF_MAX_ITERATIONS);
+    }
+    if (state->temporal_accumulation || state->denoise)
+    {
+        ImGui::SliderInt("Max history", &state->max_history, 1, ACCUMULATION_MAX_HISTORY);
+    }
+    ImGui::Combo("Sort", &state->sort_mode, "Bitonic\0Radix\0");
+    ImGui::Combo("Morton key", &state->morton_key_mode, "Position\0Position + hue\0Position + direction\0");
+    ImGui::Combo("Tree type", &state->tree_type, "Complete\0LBVH\0Complete (4-wide)\0Complete (quantized)\0");
+    if (state->tree_type == LIGHT_TREE_TYPE_WIDE || state->tree_type == LIGHT_TREE_TYPE_QUANTIZED)
+    {
+        ImGui::Checkbox("Benchmark traversal", &state->benchmark_traversal);
+    }
+    if (state->tree_type == LIGHT_TREE_TYPE_LBVH) 
+        ImGui::BeginDisabled();
+    ImGui::Combo("Tree build", &state->tree_build_mode, "Per level\0Fused\0");
+    if (state->tree_type == LIGHT_TREE_TYPE_LBVH) 
+        ImGui::EndDisabled();
+    ImGui::Combo("Tree update", &state->tree_update_mode, "Rebuild\0Refit\0");
+    if (state->tree_update_mode == TREE_UPDATE_REFIT)
+    {
+        ImGui::SliderFloat("Refit threshold", &state->refit_threshold, 1.0f, 4.0f);
+    }
+    ImGui::Checkbox("Rebuild unchanged tree", &state->always_rebuild_tree);
     ImGui::Checkbox("Random lights", &state->use_random_lights);
     if (state->use_random_lights)
     {
-        ImGui::SliderInt("Num random lights", &state->num_random_lights, 1, MAX_LIGHTS);
+        // applied on enter, the light buffers grow with the number of lights
+        ImGui::InputInt("Num random lights", &state->num_random_lights, 1024, 1 << 16, ImGuiInputTextFlags_EnterReturnsTrue);
+        state->num_random_lights = MAX(state->num_random_lights, 1);
         ImGui::SliderFloat("Distance from scene", &state->distance_from_origin, 1.0f, 100.0f);
+        ImGui::Checkbox("GPU animated lights", &state->gpu_lights);
+    }
+    if (scene->gpu_lights.count > 0 && ImGui::TreeNode("Light animation"))
+    {
+        bool changed = false;
+        for (i32 i = 0; i < LIGHT_ANIMATION_GROUPS; i++)
+        {
+            auto& group = scene->gpu_lights.groups[i];
+            ImGui::PushID(i);
+            ImGui::Text("Group %d", i);
+            changed |= ImGui::SliderFloat3("Translation", group.translation.data, 0.0f, 5.0f);
+            changed |= ImGui::SliderFloat("Translation freq", &group.translation_frequency, 0.0f, 2.0f);
+            changed |= ImGui::SliderFloat("Orbit speed", &group.orbit_speed, -2.0f, 2.0f);
+            changed |= ImGui::SliderFloat("Flicker", &group.flicker, 0.0f, 1.0f);
+            changed |= ImGui::SliderFloat("Flicker freq", &group.flicker_frequency, 0.0f, 10.0f);
+            ImGui::PopID();
+        }
+        if (changed)
+        {
+            scene->gpu_lights.groups_version++;
+        }
+        ImGui::TreePop();
+    }
+    ImGui::SliderInt("Num static lights", &state->num_static_lights, 0, MAX_STATIC_LIGHTS);
+    state->static_lights_editing = ImGui::IsItemActive();
+    ImGui::SliderFloat("Spot cone angle", &state->spot_cone_angle, 5.0f, 180.0f); // 180 = point lights
+    state->static_lights_editing |= ImGui::IsItemActive();
+    if (ImGui::Button("Compare SAOH and morton tree"))
+    {
+        state->run_tree_benchmark = true; // with the current number of samples
     }
     ImVec2 region = ImGui::GetContentRegionAvail();
     region.y = MIN(region.y, 150);
@@ -88,7 +155,10 @@ bool new_frame(imgui_t& imgui, render_state_t* state, scene_t* scene, frame_time
                 ImGui::TableNextColumn();
                 char buf[50];
                 sprintf(buf, "%d", i++); 
-                ImGui::ColorEdit3(buf, light.color.data, flags);
+                if (ImGui::ColorEdit3(buf, light.color.data, flags))
+                {
+                    update_lights_version(*scene);
+                }
             }
             ImGui::EndTable();
         }
@@ -102,44 +172,112 @@ bool new_frame(imgui_t& imgui, render_state_t* state, scene_t* scene, frame_time
     }
     ImGui::End();
 
+    ImGui::Begin("GPU timings");
+    ImGui::Text("Lights: %d (%d static)", static_cast<i32>(light_count(*scene)), static_cast<i32>(scene->static_lights.size()));
+    if (state->two_level_tree)
+    {
+        ImGui::Text("Two-level tree, %d dynamic leaf nodes", state->num_leaf_nodes);
+        ImGui::Text("Static tree (SAOH) %s in %.3f ms", state->static_tree_cached ? "loaded from cache" : "built", 
+                state->static_tree_build_ms);
+    }
+    if (state->tree_benchmark.num_lights > 0)
+    {
+        const auto& b = state->tree_benchmark;
+        ImGui::Text("Tree benchmark (%d lights, %d samples, cut size %d)", static_cast<i32>(b.num_lights), static_cast<i32>(b.num_samples), 
+                static_cast<i32>(b.cut_size));
+        ImGui::Text("  SAOH:          %.3f ms, variance %.4f", b.saoh_build_ms, b.saoh_variance);
+        ImGui::Text("  Morton:        %.3f ms, variance %.4f", b.morton_build_ms, b.morton_variance);
+        ImGui::Text("  Morton (hue):  %.3f ms, variance %.4f", b.morton_color_build_ms, b.morton_color_variance);
+        ImGui::Text("  Morton (dir):  %.3f ms, variance %.4f", b.morton_orientation_build_ms, b.morton_orientation_variance);
+        ImGui::Text("  Cut size   linear ns   heap ns");
+        for (i32 k = 0; k < CUT_BENCHMARK_SIZES; k++)
+        {
+            ImGui::Text("  %8u %11.0f %9.0f", b.cut_sizes[k], b.linear_cut_ns[k], b.heap_cut_ns[k]);
+        }
+        if (b.cut_mismatches > 0)
+        {
+            ImGui::Text("  %u cuts differ (nodes with the same error)", b.cut_mismatches);
+        }
+    }
+    // timestamps of different queues can not be compared, so there is no total over both
+    ImGui::Text("Compute queue:  %.3f ms", state->gpu_time[PROFILER_QUEUE_COMPUTE]);
+    ImGui::Text("Graphics queue: %.3f ms", state->gpu_time[PROFILER_QUEUE_GRAPHICS]);
+    if (state->tree_unchanged)
+    {
+        ImGui::Text("Tree unchanged");
+    }
+    else if (state->tree_update_mode == TREE_UPDATE_REFIT)
+    {
+        ImGui::Text("Tree %s, cost %.2f (rebuild %.2f)", state->tree_refitted ? "refitted" : "rebuilt", 
+                state->tree_cost, state->tree_rebuild_cost);
+    }
+    if (state->tree_type == LIGHT_TREE_TYPE_QUANTIZED && state->quant_unbounded_lights >= 0)
+    {
+        ImGui::Text("Quantized bounds: %d lights outside", state->quant_unbounded_lights);
+    }
+    if (state->tree_validation_ok)
+    {
+        ImGui::Text("Tree valid (%u invalid trees so far)", state->invalid_trees);
+    }
+    else
+    {
+        const auto& v = state->tree_validation;
+        ImGui::TextColored(ImVec4(1, 0.2, 0.2, 1), "Tree invalid: %u bounds, %u intensity, %u id errors (node %u)", 
+                v.bounds_errors, v.intensity_errors, v.id_errors, v.first_error_node);
+    }
+    for (auto const& timing : state->timings)
+    {
+        ImGui::Text("%-16s %.3f ms (%s)", timing.name, timing.ms, 
+                timing.queue == PROFILER_QUEUE_COMPUTE ? "compute" : "graphics");
+    }
+    ImGui::End();
+
     ImGui::Begin("Debug");
+    ImGui::Checkbox("Read back tree (stalls the frame)", &state->read_back_tree);
     region = ImGui::GetContentRegionAvail();
     if (region.y > 0 && ImGui::BeginChild("debug", region))
     {
         ImVec4 select_color = ImVec4(0, 0.823, 0.83, 1);
-        if (ImGui::BeginTable("debugtable", 3))
+        if (!state->read_back_tree)
+        {
+            ImGui::Text("Tree is not read back");
+        }
+        else if (!state->tree_read_back)
+        {
+            ImGui::Text("Tree too large to read back (max %d lights)", MAX_DEBUG_LIGHTS);
+        }
+        else if (ImGui::BeginTable("debugtable", 3))
         {
             ImGui::TableSetupColumn("Index");
             ImGui::TableSetupColumn("Id");
             ImGui::TableSetupColumn("Selected");
             ImGui::TableHeadersRow();
-            i32 num_leafs = next_pow2(scene->lights.size());
-            i32 h = static_cast<i32>(log2(num_leafs));
-            i32 num = (1 << (h + 1)) - 1;
+            // leaf nodes are at the start of the complete tree and at the end of the lbvh
+            i32 num = state->num_nodes;
+            i32 first_leaf = state->tree_type == LIGHT_TREE_TYPE_LBVH ? num - state->num_leaf_nodes : 0;
+            i32 last_leaf = first_leaf + state->num_leaf_nodes;
             for (i32 i = 0; i < num; i++)
             {
                 ImGui::TableNextRow();
                 ImGui::TableNextColumn();
                 ImGui::Text("%d", i);
                 ImGui::TableNextColumn();
-                if (i < scene->lights.size() && state->selected_leafs[i])
+                i32 id = state->cut[i].id;
+                if (i < first_leaf || i >= last_leaf)
+                {
+                    ImGui::Text("-");
+                }
+                else if (id == -1)
+                {
+                    ImGui::Text("[d]");
+                }
+                else if (id < MIN(static_cast<i32>(light_count(*scene)), MAX_DEBUG_LIGHTS) && state->selected_leafs[id])
                 {
-                    ImGui::TextColored(select_color, "%d", state->cut[i].id);
+                    ImGui::TextColored(select_color, "%d", id);
                 }
-                else 
+                else
                 {
-                    if (i >= num_leafs)
-                    {
-                        ImGui::Text("-");
-                    }
-                    else if (state->cut[i].id == -1)
-                    {
-                        ImGui::Text("[d]");
-                    }
-                    else
-                    {
-                        ImGui::Text("%d", state->cut[i].id);
-                    }
+                    ImGui::Text("%d", id);
                 }
                 ImGui::TableNextColumn();
                 ImGui::Text("%d", state->cut[i].selected);